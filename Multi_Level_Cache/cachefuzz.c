@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cachesim.h"
+#include "cacheref.h"
+
+// cachefuzz: drive cachesim and the cacheref oracle with the same random
+// access streams, over all three L2 modes and random access sizes, and
+// stop at the first access where they disagree on a hit, a miss, a
+// writeback or the bytes moved between L2 and memory.
+
+static unsigned long long rng_state;
+
+static unsigned long long rng_next(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ull;
+}
+
+// turn the counter deltas of one cachesim access into an outcome
+static cacheref_outcome_t sim_outcome(const cachesim_stats_t *before,
+                                      const cachesim_stats_t *after)
+{
+    cacheref_outcome_t out;
+    out.l1_hit = (after->d_hit - before->d_hit) +
+                 (after->i_hit - before->i_hit) != 0;
+    out.l2_hit = after->l2_hit != before->l2_hit;
+    out.l2_access = out.l2_hit || after->l2_miss != before->l2_miss;
+    out.writebacks = after->writebacks - before->writebacks;
+    out.fetch_bytes = after->l2_fetch_bytes - before->l2_fetch_bytes;
+    out.writeback_bytes = after->l2_writeback_bytes -
+                          before->l2_writeback_bytes;
+    return out;
+}
+
+static int same_outcome(cacheref_outcome_t a, cacheref_outcome_t b)
+{
+    return a.l1_hit == b.l1_hit && a.l2_access == b.l2_access &&
+           a.l2_hit == b.l2_hit && a.writebacks == b.writebacks &&
+           a.fetch_bytes == b.fetch_bytes &&
+           a.writeback_bytes == b.writeback_bytes;
+}
+
+static void print_outcome(const char *who, cacheref_outcome_t o)
+{
+    printf("  %-9s l1 %s, l2 %s, %d writebacks, %llu bytes fetched,"
+           " %llu written back\n", who,
+           o.l1_hit ? "hit" : "miss",
+           !o.l2_access ? "-" : o.l2_hit ? "hit" : "miss",
+           o.writebacks, o.fetch_bytes, o.writeback_bytes);
+}
+
+// one random configuration and stream, returns 0 when both models agree
+static int fuzz_one(int run, int length)
+{
+    static const char *const mode_names[] = {
+        "normal", "sectored", "compressed"
+    };
+    l2_mode_t mode = rng_next() % 3;
+    int blocksize = 4 << (rng_next() % 7);          // 4 - 256 bytes
+    int ways = 1 + rng_next() % (rng_next() % 2 ? 8 : 128);
+    int sets = 1 << (rng_next() % 9);               // 1 - 256 sets
+    int sectors = 1;
+
+    // 2 up to 64 sub-blocks of at least a byte, at most 64 compressed
+    // ways so that the doubled tags fit
+    if (mode == L2_SECTOR) {
+        int most = blocksize < 64 ? blocksize : 64;
+        sectors = 2;
+        while (sectors < most && rng_next() % 2)
+            sectors *= 2;
+    }
+    if (mode == L2_COMPRESSED && ways > 64)
+        ways = 64;
+    int cachesize = blocksize * ways * sets;
+
+    cachesim_init(blocksize, cachesize, ways, mode, sectors);
+    cacheref_init(blocksize, cachesize, ways, mode, sectors);
+
+    // addresses come from a pool that is a few times larger than the
+    // bigger cache, so every stream has reuse, conflicts and evictions
+    addr_t span = 4ull * (cachesize > 32768 ? cachesize : 32768);
+    addr_t base = rng_next() % 2 ? 0 : (rng_next() & 0xffffffffff00ull);
+    addr_t hot[16];
+    for (int i = 0; i < 16; i++)
+        hot[i] = base + rng_next() % span;
+
+    for (int n = 0; n < length; n++) {
+        static const char types[] = "rwi";
+        char type = types[rng_next() % 3];
+        unsigned size = 1u << (rng_next() % 4);     // 1 - 8 bytes
+        addr_t addr;
+
+        switch (rng_next() % 4) {
+        case 0:
+            addr = hot[rng_next() % 16];
+            break;
+        case 1:
+            // same set, different tags
+            addr = base + (rng_next() % 64) * cachesize +
+                   (hot[0] - base) % cachesize;
+            break;
+        default:
+            addr = base + rng_next() % span;
+            break;
+        }
+
+        cachesim_stats_t before, after;
+        cachesim_get_stats(&before);
+        l1_cachesim_access(addr, type, size);
+        cachesim_get_stats(&after);
+
+        cacheref_outcome_t sim = sim_outcome(&before, &after);
+        cacheref_outcome_t ref = cacheref_access(addr, type, size);
+        if (!same_outcome(sim, ref)) {
+            printf("mismatch in run %d at access %d: %c %llx %u\n"
+                   "  cache: %d byte blocks, %d bytes, %d ways, %s L2",
+                   run, n, type, addr, size, blocksize, cachesize, ways,
+                   mode_names[mode]);
+            if (mode == L2_SECTOR)
+                printf(", %d sub-blocks", sectors);
+            printf("\n");
+            print_outcome("cachesim", sim);
+            print_outcome("reference", ref);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int runs = argc > 1 ? atoi(argv[1]) : 200;
+    int length = argc > 2 ? atoi(argv[2]) : 20000;
+    unsigned long long seed = argc > 3 ? strtoull(argv[3], NULL, 0) : 1;
+
+    if (argc > 4 || runs <= 0 || length <= 0) {
+        fprintf(stderr, "Usage:\n  %s [runs] [accesses per run] [seed]\n",
+                argv[0]);
+        return 1;
+    }
+
+    rng_state = seed ? seed : 1;
+    for (int run = 0; run < runs; run++) {
+        if (fuzz_one(run, length) != 0) {
+            printf("seed %llu\n", seed);
+            return 1;
+        }
+    }
+
+    cachesim_free();
+    cacheref_free();
+    printf("%d runs of %d accesses: cachesim matches the reference\n",
+           runs, length);
+    return 0;
+}
@@ -0,0 +1,235 @@
+#include <stdlib.h>
+#include "cacheref.h"
+
+// L1: 256 direct-mapped 64 byte lines per cache. Like cachesim.c, a
+// lookup compares the tag only, so a cold line holding tag 0 hits.
+#define REF_L1_SETS 256
+#define REF_L1_BLOCK 64
+
+typedef struct {
+    addr_t tag;
+    int dirty;
+} ref_l1_line;
+
+// L2: one entry per tag, LRU kept as the time of last use. A sectored
+// line has a valid and a dirty flag per sub-block, a compressed line the
+// bytes it occupies in the set
+typedef struct {
+    addr_t tag;
+    int valid;
+    int dirty;
+    long long last_use;
+    int sector_valid[64];
+    int sector_dirty[64];
+    int size;
+} ref_l2_line;
+
+static ref_l1_line ref_icache[REF_L1_SETS];
+static ref_l1_line ref_dcache[REF_L1_SETS];
+static ref_l2_line *ref_l2;
+static addr_t ref_l2_sets, ref_l2_block;
+static int ref_l2_ways, ref_l2_tags, ref_l2_sectors;
+static l2_mode_t ref_l2_mode;
+static long long ref_clock;
+
+void cacheref_init(int blocksize, int cachesize, int ways, l2_mode_t mode,
+                   int sectors)
+{
+    cacheref_free();
+    ref_l2_block = blocksize;
+    ref_l2_ways = ways;
+    ref_l2_sets = cachesize / (blocksize * ways);
+    ref_l2_mode = mode;
+    ref_l2_sectors = mode == L2_SECTOR ? sectors : 1;
+    // a compressed set has twice the tags for the same data
+    ref_l2_tags = mode == L2_COMPRESSED ? 2 * ways : ways;
+    ref_l2 = calloc(ref_l2_sets * ref_l2_tags, sizeof(ref_l2_line));
+
+    // cold ways are evicted in order, way 0 first
+    for (addr_t i = 0; i < ref_l2_sets * ref_l2_tags; i++)
+        ref_l2[i].last_use = (long long) (i % ref_l2_tags) - ref_l2_tags;
+    ref_clock = 0;
+
+    for (int i = 0; i < REF_L1_SETS; i++) {
+        ref_icache[i].tag = ref_dcache[i].tag = 0;
+        ref_icache[i].dirty = ref_dcache[i].dirty = 0;
+    }
+}
+
+void cacheref_free(void)
+{
+    free(ref_l2);
+    ref_l2 = NULL;
+}
+
+// whether sub-block s of the block at block_start holds any byte of
+// [start, end)
+static int ref_overlaps(addr_t block_start, int s, addr_t start, addr_t end)
+{
+    addr_t sector_size = ref_l2_block / ref_l2_sectors;
+    addr_t first = block_start + s * sector_size;
+    return first < end && start < first + sector_size;
+}
+
+// bytes a compressed line takes when filled or written with size byte
+// accesses: an 8 byte base plus a size byte delta per 8 byte word
+static int ref_compressed_size(unsigned size)
+{
+    int compressed = 8 + (int) (ref_l2_block / 8) * size;
+    if (size >= 8 || compressed > (int) ref_l2_block)
+        return ref_l2_block;
+    return compressed;
+}
+
+static void ref_evict(ref_l2_line *line, cacheref_outcome_t *out)
+{
+    if (line->valid && line->dirty) {
+        out->writebacks++;
+        if (ref_l2_mode == L2_SECTOR) {
+            for (int s = 0; s < ref_l2_sectors; s++)
+                if (line->sector_dirty[s])
+                    out->writeback_bytes += ref_l2_block / ref_l2_sectors;
+        } else if (ref_l2_mode == L2_COMPRESSED) {
+            out->writeback_bytes += line->size;
+        } else {
+            out->writeback_bytes += ref_l2_block;
+        }
+    }
+    line->valid = 0;
+    line->dirty = 0;
+    for (int s = 0; s < 64; s++)
+        line->sector_valid[s] = line->sector_dirty[s] = 0;
+    line->size = 0;
+}
+
+// evict least recently used lines other than keep until the data in the
+// set plus extra bytes fits in ways blocks, and, with no keep, until a
+// tag is free. Returns keep or the least recently used free tag
+static ref_l2_line *ref_make_room(ref_l2_line *set, ref_l2_line *keep,
+                                  int extra, cacheref_outcome_t *out)
+{
+    while (1) {
+        ref_l2_line *lru = NULL, *free_tag = NULL;
+        int used = 0;
+        for (int w = 0; w < ref_l2_tags; w++) {
+            ref_l2_line *line = &set[w];
+            if (line->valid) {
+                used += line->size;
+                if (line != keep &&
+                    (lru == NULL || line->last_use < lru->last_use))
+                    lru = line;
+            } else if (free_tag == NULL ||
+                       line->last_use < free_tag->last_use) {
+                free_tag = line;
+            }
+        }
+        if (used + extra <= (int) ref_l2_block * ref_l2_ways &&
+            (keep != NULL || free_tag != NULL))
+            return keep != NULL ? keep : free_tag;
+        ref_evict(lru, out);
+    }
+}
+
+static void ref_l2_access(addr_t addr, char type, unsigned size,
+                          cacheref_outcome_t *out)
+{
+    addr_t block = addr / ref_l2_block;
+    ref_l2_line *set = &ref_l2[(block % ref_l2_sets) * ref_l2_tags];
+    addr_t tag = block / ref_l2_sets;
+    ref_l2_line *line = NULL;
+
+    // the sub-blocks under the L1 line need to be present, and a write
+    // dirties those under its bytes
+    addr_t block_start = block * ref_l2_block;
+    addr_t l1_start = addr / REF_L1_BLOCK * REF_L1_BLOCK;
+    int needed[64], written[64], missing = 0;
+    for (int s = 0; s < ref_l2_sectors; s++) {
+        needed[s] = ref_overlaps(block_start, s, l1_start,
+                                 l1_start + REF_L1_BLOCK);
+        written[s] = needed[s] &&
+                     ref_overlaps(block_start, s, addr,
+                                  addr + (size ? size : 1));
+    }
+
+    out->l2_access = 1;
+    for (int w = 0; w < ref_l2_tags; w++) {
+        if (set[w].valid && set[w].tag == tag)
+            line = &set[w];
+    }
+
+    if (line != NULL) {
+        for (int s = 0; s < ref_l2_sectors; s++) {
+            if (needed[s] && !line->sector_valid[s]) {
+                line->sector_valid[s] = 1;
+                missing++;
+            }
+        }
+        out->l2_hit = missing == 0;
+        out->fetch_bytes += missing * (ref_l2_block / ref_l2_sectors);
+
+        // a write too wide for the compressed line grows it
+        if (ref_l2_mode == L2_COMPRESSED && type == 'w' &&
+            ref_compressed_size(size) > line->size) {
+            int grow = ref_compressed_size(size) - line->size;
+            ref_make_room(set, line, grow, out);
+            line->size += grow;
+        }
+    } else {
+        if (ref_l2_mode == L2_COMPRESSED) {
+            line = ref_make_room(set, NULL, ref_compressed_size(size), out);
+        } else {
+            line = &set[0];
+            for (int w = 1; w < ref_l2_tags; w++) {
+                if (set[w].last_use < line->last_use)
+                    line = &set[w];
+            }
+        }
+        ref_evict(line, out);
+        line->tag = tag;
+        line->valid = 1;
+        for (int s = 0; s < ref_l2_sectors; s++) {
+            line->sector_valid[s] = needed[s];
+            if (needed[s])
+                out->fetch_bytes += ref_l2_block / ref_l2_sectors;
+        }
+        if (ref_l2_mode == L2_COMPRESSED)
+            line->size = ref_compressed_size(size);
+    }
+
+    if (type == 'w') {
+        line->dirty = 1;
+        for (int s = 0; s < ref_l2_sectors; s++)
+            if (written[s])
+                line->sector_dirty[s] = 1;
+    }
+    line->last_use = ++ref_clock;
+}
+
+cacheref_outcome_t cacheref_access(addr_t addr, char type, unsigned size)
+{
+    cacheref_outcome_t out = { 0, 0, 0, 0, 0, 0 };
+    ref_l1_line *l1;
+
+    if (type == 'r' || type == 'w')
+        l1 = ref_dcache;
+    else if (type == 'i')
+        l1 = ref_icache;
+    else
+        return out;
+
+    addr_t block = addr / REF_L1_BLOCK;
+    ref_l1_line *line = &l1[block % REF_L1_SETS];
+    addr_t tag = block / REF_L1_SETS;
+
+    if (line->tag == tag) {
+        out.l1_hit = 1;
+    } else {
+        ref_l2_access(addr, type, size, &out);
+        line->tag = tag;
+        line->dirty = 0;
+    }
+    if (type == 'w')
+        line->dirty = 1;
+
+    return out;
+}
@@ -0,0 +1,23 @@
+#ifndef __CACHEREF_H
+#define __CACHEREF_H
+
+#include "cachesim.h"
+
+// cacheref: a deliberately naive model of the hierarchy in cachesim.c,
+// used as the oracle by cachefuzz. Keep it simple rather than fast.
+
+// what happened on one access
+typedef struct {
+    int l1_hit;         // hit in the L1 selected by the access type
+    int l2_access;      // the L1 missed and went to L2
+    int l2_hit;
+    int writebacks;     // dirty L2 blocks evicted
+    counter_t fetch_bytes;      // read from memory into L2
+    counter_t writeback_bytes;  // written from L2 back to memory
+} cacheref_outcome_t;
+
+void cacheref_init(int, int, int, l2_mode_t, int);
+void cacheref_free(void);
+cacheref_outcome_t cacheref_access(addr_t, char, unsigned);
+
+#endif
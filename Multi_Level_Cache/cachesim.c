@@ -18,13 +18,50 @@ unsigned int l1_offset_size, l1_index_size, l1_tag_size, l1_index_max;
 
 counter_t write_miss = 0, write_count = 0, read_count = 0, fetch_count = 0;
 
+// l2 organisation
+l2_mode_t l2_mode;
+unsigned int l2_blocksize, l2_sector_size, l2_set_budget;
+counter_t l2_sector_miss = 0, l2_fetch_bytes = 0, l2_writeback_bytes = 0;
+counter_t l2_fills = 0, l2_fill_compressed_bytes = 0;
+
+// bytes moved between L1 and L2, the L2 <-> memory side is counted by
+// l2_fetch_bytes and l2_writeback_bytes above
+counter_t l1i_fill_bytes = 0, l1d_fill_bytes = 0, l1d_writeback_bytes = 0;
+
+// energy figures in pJ, see cachesim_set_energy(); the traffic and
+// energy tables are only printed after cachesim_report_energy()
+cachesim_energy_t energy = { 10.0, 50.0, 2000.0, 1.0, 20.0 };
+bool energy_report = false;
+
 // Initialize caches to 0's and -1 for invalid
-void cachesim_init(int l2_blocksize, int l2_cachesize, int l2_ways)
+// l2_sectors is the number of sub-blocks per L2 block in L2_SECTOR mode
+void cachesim_init(int blocksize, int l2_cachesize, int l2_ways,
+                   l2_mode_t mode, int l2_sectors)
 {
+    // start from a clean slate so the simulator can be re-initialized
+    cachesim_free();
+    accesses = hits = misses = writebacks = 0;
+    d_hit = d_miss = i_hit = i_miss = l2_hit = l2_miss = 0;
+    write_miss = write_count = read_count = fetch_count = 0;
+    l2_sector_miss = l2_fetch_bytes = l2_writeback_bytes = 0;
+    l2_fills = l2_fill_compressed_bytes = 0;
+    l1i_fill_bytes = l1d_fill_bytes = l1d_writeback_bytes = 0;
+
     // L2 CACHE
+    l2_blocksize = blocksize;
     l2_index_max = l2_cachesize / (l2_blocksize * l2_ways);
     l2_index_size = (unsigned int) log2(l2_index_max);
     l2_offset_size = (unsigned int) log2(l2_blocksize);
+
+    // a sectored block keeps one valid/dirty bit per sub-block, a
+    // compressed set has twice the tags but only l2_ways blocks of data
+    l2_mode = mode;
+    l2_sector_size = l2_blocksize;
+    if (mode == L2_SECTOR && l2_sectors > 1 && l2_sectors <= 64)
+        l2_sector_size = l2_blocksize / l2_sectors;
+    l2_set_budget = l2_blocksize * l2_ways;
+    if (mode == L2_COMPRESSED && l2_ways <= 64)
+        l2_ways *= 2;
     l2_tag_size = (unsigned int) (64 - l2_index_size - l2_offset_size);
 
     // L1 CACHE
@@ -49,12 +86,18 @@ void cachesim_init(int l2_blocksize, int l2_cachesize, int l2_ways)
                 l2_cache[i].validBit[j] = 0;
                 l2_cache[i].dirtyBit[j] = 0;
                 l2_cache[i].LRU_counter[j] = j;
+                l2_cache[i].sectorValid[j] = 0;
+                l2_cache[i].sectorDirty[j] = 0;
+                l2_cache[i].compressedSize[j] = 0;
             }
             else {
                 l2_cache[i].tag[j] = -1;
                 l2_cache[i].validBit[j] = -1;
                 l2_cache[i].dirtyBit[j] = -1;
                 l2_cache[i].LRU_counter[j] = -1;
+                l2_cache[i].sectorValid[j] = 0;
+                l2_cache[i].sectorDirty[j] = 0;
+                l2_cache[i].compressedSize[j] = 0;
             }
         }
     }
@@ -71,8 +114,19 @@ void cachesim_init(int l2_blocksize, int l2_cachesize, int l2_ways)
     }
 }
 
+// release the arrays allocated by cachesim_init
+void cachesim_free(void)
+{
+    free(l2_cache);
+    free(i_cache);
+    free(d_cache);
+    l2_cache = NULL;
+    i_cache = NULL;
+    d_cache = NULL;
+}
+
 // l1_cache
-void l1_cachesim_access(addr_t physical_addr, char input)
+void l1_cachesim_access(addr_t physical_addr, char input, unsigned size)
 {
 
     // L1 CACHE
@@ -102,12 +156,14 @@ void l1_cachesim_access(addr_t physical_addr, char input)
         {
             d_miss++;
             // check into l2 ()
-            l2_cachesim_access(physical_addr, input);
+            l2_cachesim_access(physical_addr, input, size);
+            l1d_fill_bytes += 1 << l1_offset_size;
 
-            // increment write_back and reset dirtybit to 0
+            // count the write_back traffic and reset dirtybit to 0
             if (d_cache[l1_index].dirtyBit == 1)
             {
                 //writebacks++;
+                l1d_writeback_bytes += 1 << l1_offset_size;
                 d_cache[l1_index].dirtyBit = 0;
             }
         
@@ -136,7 +192,8 @@ void l1_cachesim_access(addr_t physical_addr, char input)
         {
             i_miss++;
             // check into l2 ()
-            l2_cachesim_access(physical_addr, input);
+            l2_cachesim_access(physical_addr, input, size);
+            l1i_fill_bytes += 1 << l1_offset_size;
 
             // increment write_back and reset dirtybit to 0
             if (i_cache[l1_index].dirtyBit == 1)
@@ -162,8 +219,91 @@ void l1_cachesim_access(addr_t physical_addr, char input)
     }
 }
 
+// bytes a block occupies in L2_COMPRESSED mode. There is no data in the
+// trace, so the access size stands in for the value width: a block
+// touched with n byte accesses is stored base-delta style as one 8 byte
+// base plus an n byte delta per 8 byte word, or uncompressed when that
+// does not save anything
+int l2_compressed_size(unsigned size)
+{
+    int compressed = 8 + (l2_blocksize / 8) * size;
+    if (size >= 8 || compressed > l2_blocksize)
+        return l2_blocksize;
+    return compressed;
+}
+
+// the sub-blocks of the block physical_addr falls in that hold any of the
+// bytes bytes from physical_addr on, one bit per sub-block
+unsigned long long l2_sector_mask(addr_t physical_addr, unsigned bytes)
+{
+    if (l2_sector_size == l2_blocksize)
+        return 1;
+
+    addr_t offset = physical_addr & (l2_blocksize - 1);
+    addr_t end = offset + (bytes ? bytes : 1);
+    if (end > l2_blocksize)
+        end = l2_blocksize;
+    unsigned first = offset / l2_sector_size;
+    unsigned last = (end - 1) / l2_sector_size;
+    unsigned long long mask = ~0ull >> (63 - last);
+    return mask & ~((1ull << first) - 1);
+}
+
+// drop a block from a set, writing back whatever is dirty
+void l2_evict(l2_cache_struct *set, int block_index)
+{
+    if (set->validBit[block_index] == 1 && set->dirtyBit[block_index] == 1) {
+        writebacks++;
+        if (l2_mode == L2_SECTOR)
+            l2_writeback_bytes += (counter_t) l2_sector_size *
+                __builtin_popcountll(set->sectorDirty[block_index]);
+        else if (l2_mode == L2_COMPRESSED)
+            l2_writeback_bytes += set->compressedSize[block_index];
+        else
+            l2_writeback_bytes += l2_blocksize;
+    }
+    set->validBit[block_index] = 0;
+    set->dirtyBit[block_index] = 0;
+    set->sectorValid[block_index] = 0;
+    set->sectorDirty[block_index] = 0;
+    set->compressedSize[block_index] = 0;
+}
+
+// least recently used block of a set, optionally skipping one block and
+// optionally only looking at valid blocks
+int l2_lru_block(const l2_cache_struct *set, int skip, int valid_only)
+{
+    int best = -1;
+    for (int i = 0; i < max_LRU; i++) {
+        if (i == skip || (valid_only && set->validBit[i] != 1))
+            continue;
+        if (best == -1 || set->LRU_counter[i] < set->LRU_counter[best])
+            best = i;
+    }
+    return best;
+}
+
+// in L2_COMPRESSED mode evict LRU blocks, other than keep, until the set
+// has a free tag (when keep is -1) and extra more bytes of data fit
+int l2_compressed_make_room(l2_cache_struct *set, int keep, int extra)
+{
+    while (1) {
+        int used = 0, free_tag = -1;
+        for (int i = 0; i < max_LRU; i++) {
+            if (set->validBit[i] == 1)
+                used += set->compressedSize[i];
+            else if (free_tag == -1 ||
+                     set->LRU_counter[i] < set->LRU_counter[free_tag])
+                free_tag = i;
+        }
+        if (used + extra <= l2_set_budget && (keep != -1 || free_tag != -1))
+            return keep != -1 ? keep : free_tag;
+        l2_evict(set, l2_lru_block(set, keep, 1));
+    }
+}
+
 // l2 cache
-void l2_cachesim_access(addr_t physical_addr, char input)
+void l2_cachesim_access(addr_t physical_addr, char input, unsigned size)
 {
     // get set
     addr_t set =  physical_addr << l2_tag_size;
@@ -172,6 +312,14 @@ void l2_cachesim_access(addr_t physical_addr, char input)
     addr_t tag = physical_addr >> (l2_index_size + l2_offset_size);
     // get index
     addr_t index = set >> l2_offset_size;
+    l2_cache_struct *cache = &l2_cache[index];
+    // the L1 fills a whole line, so every sub-block under it is needed;
+    // a write dirties the sub-blocks it touches
+    addr_t l1_line = physical_addr & ~((1ull << l1_offset_size) - 1);
+    unsigned long long sectors = l2_sector_mask(l1_line,
+                                                1u << l1_offset_size);
+    unsigned long long written = l2_sector_mask(physical_addr, size) &
+                                 sectors;
      
     // accesses
     accesses++;
@@ -179,72 +327,136 @@ void l2_cachesim_access(addr_t physical_addr, char input)
     write_count++;
 
     // condition for hit
-    int block_index = check_tag_and_validBit(l2_cache[index], tag);
+    int block_index = check_tag_and_validBit(cache, tag);
        
     // hit
-    if (block_index != -1) {
+    if (block_index != -1 &&
+        (cache->sectorValid[block_index] & sectors) == sectors) {
         
         l2_hit++;
 
-        // set dirty bit to 1
+        // a narrower encoding may no longer hold the written value
+        if (l2_mode == L2_COMPRESSED && input == 'w' &&
+            l2_compressed_size(size) > cache->compressedSize[block_index]) {
+            int grow = l2_compressed_size(size) -
+                       cache->compressedSize[block_index];
+            l2_compressed_make_room(cache, block_index, grow);
+            cache->compressedSize[block_index] += grow;
+        }
+    }
+    // the block is present but some of the sub-blocks are not: fetch
+    // just those
+    else if (block_index != -1) {
+        unsigned long long missing = sectors &
+                                     ~cache->sectorValid[block_index];
+        l2_miss++;
+        l2_sector_miss++;
+        l2_fetch_bytes += (counter_t) l2_sector_size *
+                          __builtin_popcountll(missing);
+        cache->sectorValid[block_index] |= missing;
         if (input == 'w')
-        l2_cache[index].dirtyBit[block_index] = 1;
+            write_miss++;
     }
     // miss
     else {
         l2_miss++;
-        block_index = get_LRU_index(l2_cache[index]);
+        if (l2_mode == L2_COMPRESSED)
+            block_index = l2_compressed_make_room(cache, -1,
+                                                  l2_compressed_size(size));
+        else
+            block_index = get_LRU_index(cache);
        
-        // increment write_back and reset dirtybit to 0
-        if (l2_cache[index].dirtyBit[block_index] == 1) {
-            writebacks++;
-            l2_cache[index].dirtyBit[block_index] = 0;
-        }
+        // write back the victim and reset dirtybit to 0
+        l2_evict(cache, block_index);
 
         // update tag
-        l2_cache[index].tag[block_index] = tag;
+        cache->tag[block_index] = tag;
         
         // update valid bit
-        l2_cache[index].validBit[block_index] = 1;
-        
-        // set dirty to 1 and incremment write_miss
-        if (input == 'w') {
-            l2_cache[index].dirtyBit[block_index] = 1;
-            write_miss++;
+        cache->validBit[block_index] = 1;
+        cache->sectorValid[block_index] = sectors;
+        l2_fetch_bytes += (counter_t) l2_sector_size *
+                          __builtin_popcountll(sectors);
+
+        if (l2_mode == L2_COMPRESSED) {
+            cache->compressedSize[block_index] = l2_compressed_size(size);
+            l2_fills++;
+            l2_fill_compressed_bytes += cache->compressedSize[block_index];
         }
+
+        // incremment write_miss
+        if (input == 'w')
+            write_miss++;
+    }
+
+    // set dirty bit to 1
+    if (input == 'w') {
+        cache->dirtyBit[block_index] = 1;
+        cache->sectorDirty[block_index] |= written;
     }
 
     // set LRU counter
     for (int i = 0; i < 128; i++) {     
-        if (l2_cache[index].LRU_counter[i] != -1) {
-            if (l2_cache[index].LRU_counter[i] > l2_cache[index].LRU_counter[block_index]) {
-            l2_cache[index].LRU_counter[i]--;
+        if (cache->LRU_counter[i] != -1) {
+            if (cache->LRU_counter[i] > cache->LRU_counter[block_index]) {
+            cache->LRU_counter[i]--;
             }
         }
     }
-    l2_cache[index].LRU_counter[block_index] = max_LRU - 1;
+    cache->LRU_counter[block_index] = max_LRU - 1;
 }
 
 // loop over LRU array to find 0
-int get_LRU_index(l2_cache_struct cache) {
+int get_LRU_index(const l2_cache_struct *cache) {
 
     for (int i = 0; i < 128; i++) {
-        if (cache.LRU_counter[i] == 0)
+        if (cache->LRU_counter[i] == 0)
         return i;
     }
     return -1;
 }
 
 // tag if the tags match and valid bit
-int check_tag_and_validBit(l2_cache_struct cache, addr_t tag) {
+int check_tag_and_validBit(const l2_cache_struct *cache, addr_t tag) {
     
     for (int i = 0; i < 128; i++) {
-        if (cache.tag[i] != -1 && cache.validBit[i] && cache.tag[i] == tag)
+        if (cache->tag[i] != -1 && cache->validBit[i] == 1 && cache->tag[i] == tag)
         return i;
     }
     return -1;
 }
 
+// copy the counters out for tools that drive the simulator directly
+void cachesim_get_stats(cachesim_stats_t *stats)
+{
+    stats->accesses = accesses;
+    stats->d_hit = d_hit;
+    stats->d_miss = d_miss;
+    stats->i_hit = i_hit;
+    stats->i_miss = i_miss;
+    stats->l2_hit = l2_hit;
+    stats->l2_miss = l2_miss;
+    stats->writebacks = writebacks;
+    stats->l2_sector_miss = l2_sector_miss;
+    stats->l2_fetch_bytes = l2_fetch_bytes;
+    stats->l2_writeback_bytes = l2_writeback_bytes;
+    stats->l1i_fill_bytes = l1i_fill_bytes;
+    stats->l1d_fill_bytes = l1d_fill_bytes;
+    stats->l1d_writeback_bytes = l1d_writeback_bytes;
+}
+
+// replace the default per-access and per-byte energy figures
+void cachesim_set_energy(const cachesim_energy_t *figures)
+{
+    energy = *figures;
+}
+
+// print the traffic and energy tables with the other statistics
+void cachesim_report_energy(void)
+{
+    energy_report = true;
+}
+
 // prinf function
 void cachesim_print_stats() {
     
@@ -265,4 +477,184 @@ void cachesim_print_stats() {
     printf("I miss rate\t=\t%f\n", (double) i_miss / (double) (i_miss + i_hit));
     printf("L2 miss rate\t=\t%f\n", (double) l2_miss / (double) (l2_miss + l2_hit));
     printf("Glob miss rate\t=\t%f\n", (double) l2_miss / (double) (d_miss + i_miss + l2_hit));
+
+    if (l2_mode == L2_SECTOR) {
+        printf("L2 sector miss\t=\t%llu\n", l2_sector_miss);
+        printf("L2 sector size\t=\t%u bytes\n", l2_sector_size);
+    }
+    if (l2_mode == L2_COMPRESSED)
+        printf("L2 compressed\t=\t%f of block size\n",
+               (double) l2_fill_compressed_bytes /
+               (double) (l2_fills * l2_blocksize));
+
+    if (!energy_report)
+        return;
+
+    // traffic between each pair of levels, the instruction cache is
+    // never written so it has nothing to write back
+    printf("\nTraffic (bytes)\tfill\t\twriteback\n");
+    printf("L1I <-> L2\t%-12llu\t-\n", l1i_fill_bytes);
+    printf("L1D <-> L2\t%-12llu\t%llu\n", l1d_fill_bytes,
+           l1d_writeback_bytes);
+    printf("L2 <-> Mem\t%-12llu\t%llu\n", l2_fetch_bytes,
+           l2_writeback_bytes);
+
+    // every L2 miss reads memory, every L2 writeback writes it
+    counter_t l1_accesses = d_hit + d_miss + i_hit + i_miss;
+    counter_t mem_accesses = l2_miss + writebacks;
+    double l1_pj = l1_accesses * energy.l1_access;
+    double l2_pj = (l2_hit + l2_miss) * energy.l2_access;
+    double mem_pj = mem_accesses * energy.mem_access;
+    double l1_l2_pj = (l1i_fill_bytes + l1d_fill_bytes +
+                       l1d_writeback_bytes) * energy.l1_l2_byte;
+    double l2_mem_pj = (l2_fetch_bytes + l2_writeback_bytes) *
+                       energy.l2_mem_byte;
+    double total_pj = l1_pj + l2_pj + mem_pj + l1_l2_pj + l2_mem_pj;
+
+    printf("\nEnergy (pJ)\n");
+    printf("L1 access\t=\t%.0f\n", l1_pj);
+    printf("L2 access\t=\t%.0f\n", l2_pj);
+    printf("Mem access\t=\t%.0f\n", mem_pj);
+    printf("L1 <-> L2\t=\t%.0f\n", l1_l2_pj);
+    printf("L2 <-> Mem\t=\t%.0f\n", l2_mem_pj);
+    printf("Total\t\t=\t%.0f\n", total_pj);
+    printf("pJ/access\t=\t%f\n", total_pj / (double) l1_accesses);
+}
+
+// checkpoint file layout (host byte order):
+//   magic, version, l2 sets, l2 offset bits, l2 ways
+//   every counter in checkpoint_counters[]
+//   i_cache then d_cache: tag (8 bytes) + flags (1 byte) per set
+//   l2_cache: tag (8 bytes) + flags (1 byte) + LRU (1 byte) per valid way,
+//     then sector valid/dirty masks (8 bytes each) and compressed size
+//     (2 bytes) unless the L2 is in L2_NORMAL mode
+// only the first max_LRU ways of each L2 set are stored, the rest are
+// always the -1 padding written by cachesim_init
+#define CHECKPOINT_MAGIC 0x4d495343u    // "CSIM"
+#define CHECKPOINT_VERSION 3u
+#define CHECKPOINT_VALID 0x1
+#define CHECKPOINT_DIRTY 0x2
+
+static counter_t *const checkpoint_counters[] = {
+    &accesses, &hits, &misses, &writebacks,
+    &d_hit, &d_miss, &i_hit, &i_miss, &l2_hit, &l2_miss,
+    &write_miss, &write_count, &read_count, &fetch_count,
+    &l2_sector_miss, &l2_fetch_bytes, &l2_writeback_bytes,
+    &l2_fills, &l2_fill_compressed_bytes,
+    &l1i_fill_bytes, &l1d_fill_bytes, &l1d_writeback_bytes
+};
+#define CHECKPOINT_COUNTERS \
+    (sizeof(checkpoint_counters) / sizeof(checkpoint_counters[0]))
+
+static unsigned char checkpoint_flags(int validBit, int dirtyBit)
+{
+    return (validBit == 1 ? CHECKPOINT_VALID : 0) |
+           (dirtyBit == 1 ? CHECKPOINT_DIRTY : 0);
+}
+
+// write the whole hierarchy to path, returns 0 on success
+int cachesim_checkpoint(const char *path)
+{
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL)
+        return -1;
+
+    unsigned int header[7] = { CHECKPOINT_MAGIC, CHECKPOINT_VERSION,
+                               l2_index_max, l2_offset_size, max_LRU,
+                               l2_mode, l2_sector_size };
+    fwrite(header, sizeof(header), 1, fp);
+
+    for (int i = 0; i < CHECKPOINT_COUNTERS; i++)
+        fwrite(checkpoint_counters[i], sizeof(counter_t), 1, fp);
+
+    l1_cache_struct *l1[2] = { i_cache, d_cache };
+    for (int c = 0; c < 2; c++) {
+        for (int i = 0; i < l1_index_max; i++) {
+            unsigned char flags = checkpoint_flags(l1[c][i].validBit,
+                                                   l1[c][i].dirtyBit);
+            fwrite(&l1[c][i].tag, sizeof(addr_t), 1, fp);
+            fwrite(&flags, 1, 1, fp);
+        }
+    }
+
+    for (int i = 0; i < l2_index_max; i++) {
+        for (int j = 0; j < max_LRU; j++) {
+            unsigned char flags = checkpoint_flags(l2_cache[i].validBit[j],
+                                                   l2_cache[i].dirtyBit[j]);
+            unsigned char lru = (unsigned char) l2_cache[i].LRU_counter[j];
+            fwrite(&l2_cache[i].tag[j], sizeof(addr_t), 1, fp);
+            fwrite(&flags, 1, 1, fp);
+            fwrite(&lru, 1, 1, fp);
+            if (l2_mode != L2_NORMAL) {
+                unsigned short compressed = l2_cache[i].compressedSize[j];
+                fwrite(&l2_cache[i].sectorValid[j], 8, 1, fp);
+                fwrite(&l2_cache[i].sectorDirty[j], 8, 1, fp);
+                fwrite(&compressed, 2, 1, fp);
+            }
+        }
+    }
+
+    int error = ferror(fp);
+    if (fclose(fp) != 0 || error)
+        return -1;
+    return 0;
+}
+
+// load a checkpoint written by cachesim_checkpoint() into caches that
+// cachesim_init() has already built with the same geometry
+int cachesim_restore(const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+        return -1;
+
+    unsigned int header[7];
+    if (fread(header, sizeof(header), 1, fp) != 1 ||
+        header[0] != CHECKPOINT_MAGIC || header[1] != CHECKPOINT_VERSION ||
+        header[2] != l2_index_max || header[3] != l2_offset_size ||
+        header[4] != max_LRU || header[5] != l2_mode ||
+        header[6] != l2_sector_size) {
+        fclose(fp);
+        return -1;
+    }
+
+    int ok = 1;
+    for (int i = 0; i < CHECKPOINT_COUNTERS; i++)
+        ok &= fread(checkpoint_counters[i], sizeof(counter_t), 1, fp) == 1;
+
+    l1_cache_struct *l1[2] = { i_cache, d_cache };
+    for (int c = 0; c < 2; c++) {
+        for (int i = 0; i < l1_index_max; i++) {
+            unsigned char flags = 0;
+            ok &= fread(&l1[c][i].tag, sizeof(addr_t), 1, fp) == 1;
+            ok &= fread(&flags, 1, 1, fp) == 1;
+            l1[c][i].validBit = (flags & CHECKPOINT_VALID) != 0;
+            l1[c][i].dirtyBit = (flags & CHECKPOINT_DIRTY) != 0;
+        }
+    }
+
+    for (int i = 0; i < l2_index_max; i++) {
+        for (int j = 0; j < max_LRU; j++) {
+            unsigned char flags = 0, lru = 0;
+            ok &= fread(&l2_cache[i].tag[j], sizeof(addr_t), 1, fp) == 1;
+            ok &= fread(&flags, 1, 1, fp) == 1;
+            ok &= fread(&lru, 1, 1, fp) == 1;
+            l2_cache[i].validBit[j] = (flags & CHECKPOINT_VALID) != 0;
+            l2_cache[i].dirtyBit[j] = (flags & CHECKPOINT_DIRTY) != 0;
+            l2_cache[i].LRU_counter[j] = lru;
+            if (l2_mode != L2_NORMAL) {
+                unsigned short compressed = 0;
+                ok &= fread(&l2_cache[i].sectorValid[j], 8, 1, fp) == 1;
+                ok &= fread(&l2_cache[i].sectorDirty[j], 8, 1, fp) == 1;
+                ok &= fread(&compressed, 2, 1, fp) == 1;
+                l2_cache[i].compressedSize[j] = compressed;
+            } else {
+                l2_cache[i].sectorValid[j] = l2_cache[i].validBit[j];
+                l2_cache[i].sectorDirty[j] = l2_cache[i].dirtyBit[j];
+            }
+        }
+    }
+
+    fclose(fp);
+    return ok ? 0 : -1;
 }
@@ -6,11 +6,24 @@
 typedef unsigned long long addr_t;
 typedef unsigned long long counter_t;
 
+// L2 organisation selected in cachesim_init
+//   L2_NORMAL     whole blocks are fetched and written back
+//   L2_SECTOR     one tag per block, valid/dirty bits per sub-block
+//   L2_COMPRESSED twice the tags, blocks stored at their compressed size
+typedef enum {
+    L2_NORMAL = 0,
+    L2_SECTOR,
+    L2_COMPRESSED
+} l2_mode_t;
+
 typedef struct {
     addr_t tag[128];
     int validBit[128];
     int dirtyBit[128];
     int LRU_counter[128];
+    unsigned long long sectorValid[128];
+    unsigned long long sectorDirty[128];
+    int compressedSize[128];
 } l2_cache_struct;
 
 typedef struct {
@@ -19,18 +32,41 @@ typedef struct {
     int dirtyBit;
 } l1_cache_struct;
 
+// snapshot of the counters behind cachesim_print_stats()
+typedef struct {
+    counter_t accesses;
+    counter_t d_hit, d_miss, i_hit, i_miss;
+    counter_t l2_hit, l2_miss, writebacks;
+    counter_t l2_sector_miss, l2_fetch_bytes, l2_writeback_bytes;
+    counter_t l1i_fill_bytes, l1d_fill_bytes, l1d_writeback_bytes;
+} cachesim_stats_t;
+
+// energy figures in pJ for the pJ/access report
+typedef struct {
+    double l1_access;       // per L1 lookup
+    double l2_access;       // per L2 lookup
+    double mem_access;      // per memory read or write
+    double l1_l2_byte;      // per byte moved between L1 and L2
+    double l2_mem_byte;     // per byte moved between L2 and memory
+} cachesim_energy_t;
+
 
 
-void cachesim_init(int, int, int);
-void l1_cachesim_access(addr_t, char);
-void l2_cachesim_access(addr_t, char);
+void cachesim_init(int, int, int, l2_mode_t, int);
+void cachesim_free(void);
+void l1_cachesim_access(addr_t, char, unsigned);
+void l2_cachesim_access(addr_t, char, unsigned);
 int check_hit_l1_cache(l1_cache_struct, addr_t);
 int check_hit_l2_cache(l2_cache_struct, addr_t);
-int get_LRU_index(l2_cache_struct);
+int get_LRU_index(const l2_cache_struct *);
 void cachesim_print_stats(void);
+void cachesim_get_stats(cachesim_stats_t *);
+void cachesim_set_energy(const cachesim_energy_t *);
+void cachesim_report_energy(void);
+int cachesim_checkpoint(const char *);
+int cachesim_restore(const char *);
 
-int get_LRU_index(l2_cache_struct);
-int check_tag_and_validBit(l2_cache_struct cache, addr_t tag);
+int check_tag_and_validBit(const l2_cache_struct *cache, addr_t tag);
 
 
 #endif
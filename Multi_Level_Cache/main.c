@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "cachesim.h"
 
@@ -17,24 +18,85 @@ int next_line(FILE* trace) {
     fscanf(trace, "%c %llx %llx %u\n", &c, &va, &pa, &sz);
     prev_addr = pa;
     
-    l1_cachesim_access(pa, c);
+    l1_cachesim_access(pa, c, sz);
   }
   return 1;
 }
 
 int main(int argc, char **argv) {
   FILE *input;
+  const char *checkpoint = NULL, *restore = NULL;
+  l2_mode_t mode = L2_NORMAL;
+  int sectors = 1;
+  cachesim_energy_t energy;
+  int set_energy = 0;
 
-  if (argc != 5) {
-    fprintf(stderr, "Usage:\n  %s <trace> <block size(bytes)>"
+  // options come before the positional arguments
+  int arg = 1;
+  while (arg < argc && strncmp(argv[arg], "--", 2) == 0) {
+    if (strcmp(argv[arg], "--compressed") == 0) {
+      mode = L2_COMPRESSED;
+      arg++;
+      continue;
+    }
+    if (arg + 1 >= argc) break;
+    if (strcmp(argv[arg], "--checkpoint") == 0) checkpoint = argv[arg + 1];
+    else if (strcmp(argv[arg], "--restore") == 0) restore = argv[arg + 1];
+    else if (strcmp(argv[arg], "--energy") == 0) {
+      // "default" keeps the built-in figures
+      if (strcmp(argv[arg + 1], "default") == 0) set_energy = 1;
+      else if (sscanf(argv[arg + 1], "%lf,%lf,%lf,%lf,%lf", &energy.l1_access,
+                      &energy.l2_access, &energy.mem_access,
+                      &energy.l1_l2_byte, &energy.l2_mem_byte) == 5)
+        set_energy = 2;
+      else break;
+    }
+    else if (strcmp(argv[arg], "--sectors") == 0) {
+      mode = L2_SECTOR;
+      sectors = atoi(argv[arg + 1]);
+    }
+    else break;
+    arg += 2;
+  }
+
+  if (argc - arg != 4) {
+    fprintf(stderr, "Usage:\n  %s [--restore <file>] [--checkpoint <file>]"
+                    " [--sectors <n> | --compressed]\n"
+                    "     [--energy default | --energy <L1,L2,mem pJ/access>,"
+                    "<L1-L2,L2-mem pJ/byte>]\n"
+                    "     <trace> <block size(bytes)>"
                     " <cache size(bytes)> <ways>\n", argv[0]);
     return 1;
   }
 
-  input = open_trace(argv[1]);
-  cachesim_init(atol(argv[2]), atol(argv[3]), atol(argv[4]));
+  int blocksize = atol(argv[arg + 1]), ways = atol(argv[arg + 3]);
+  if (mode == L2_SECTOR && (sectors < 2 || sectors > 64 ||
+                            blocksize % sectors != 0)) {
+    fprintf(stderr, "%s: --sectors must divide the block size into"
+                    " 2 to 64 sub-blocks\n", argv[0]);
+    return 1;
+  }
+  if (mode == L2_COMPRESSED && ways > 64) {
+    fprintf(stderr, "%s: --compressed supports at most 64 ways\n", argv[0]);
+    return 1;
+  }
+
+  input = open_trace(argv[arg]);
+  cachesim_init(blocksize, atol(argv[arg + 2]), ways, mode, sectors);
+  if (set_energy == 2) cachesim_set_energy(&energy);
+  if (set_energy) cachesim_report_energy();
+  if (restore != NULL && cachesim_restore(restore) != 0) {
+    fprintf(stderr, "%s: cannot restore a checkpoint for this cache"
+                    " from %s\n", argv[0], restore);
+    return 1;
+  }
   while (next_line(input));
   cachesim_print_stats();
 
+  if (checkpoint != NULL && cachesim_checkpoint(checkpoint) != 0) {
+    fprintf(stderr, "%s: cannot write checkpoint %s\n", argv[0], checkpoint);
+    return 1;
+  }
+
   return 0;
 }
@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// tracegen: synthetic traces in the format main.c reads
+//   <r|w|i> <virtual addr> <physical addr> <size>
+// the address space is identity mapped, so both addresses are equal
+
+typedef unsigned long long addr_t;
+
+#define BLOCK 64
+
+// generator parameters, see usage()
+unsigned long long count = 1000000;
+unsigned long long working_set = 1 << 20;
+unsigned long long stride = 256;
+unsigned int size = 4;
+double alpha = 1.0;
+double i_frac = 0.0;
+double w_frac = 0.3;
+unsigned long long seed = 1;
+
+const addr_t data_base = 0x10000000ull;
+const addr_t code_base = 0x00400000ull;
+const unsigned long long code_size = 16 * 1024;
+
+// xorshift64*, so traces do not depend on the libc rand()
+unsigned long long rng_state;
+
+unsigned long long rng_next(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ull;
+}
+
+double rng_uniform(void)
+{
+    return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// pointer-chase: one random cycle over every block of the working set
+unsigned long long *chase_next;
+unsigned long long chase_pos;
+
+void chase_init(unsigned long long blocks)
+{
+    chase_next = malloc(blocks * sizeof(unsigned long long));
+    for (unsigned long long i = 0; i < blocks; i++)
+        chase_next[i] = i;
+    // Sattolo's algorithm yields a single cycle
+    for (unsigned long long i = blocks - 1; i > 0; i--) {
+        unsigned long long j = rng_next() % i;
+        unsigned long long t = chase_next[i];
+        chase_next[i] = chase_next[j];
+        chase_next[j] = t;
+    }
+    chase_pos = 0;
+}
+
+// zipfian: cumulative popularity of each block, sampled by binary search
+double *zipf_cdf;
+unsigned long long zipf_blocks;
+
+void zipf_init(unsigned long long blocks)
+{
+    double sum = 0;
+    zipf_cdf = malloc(blocks * sizeof(double));
+    zipf_blocks = blocks;
+    for (unsigned long long i = 0; i < blocks; i++) {
+        sum += 1.0 / pow((double) (i + 1), alpha);
+        zipf_cdf[i] = sum;
+    }
+    for (unsigned long long i = 0; i < blocks; i++)
+        zipf_cdf[i] /= sum;
+}
+
+unsigned long long zipf_sample(void)
+{
+    double u = rng_uniform();
+    unsigned long long lo = 0, hi = zipf_blocks - 1;
+    while (lo < hi) {
+        unsigned long long mid = (lo + hi) / 2;
+        if (zipf_cdf[mid] < u)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    // scatter hot blocks over the address space instead of packing them
+    return (lo * 2654435761ull) % zipf_blocks;
+}
+
+// instruction stream: straight-line code with an occasional taken branch
+addr_t code_pc;
+
+addr_t next_code(void)
+{
+    if (rng_uniform() < 0.1)
+        code_pc = code_base + (rng_next() % code_size & ~3ull);
+    else
+        code_pc = code_base + (code_pc - code_base + 4) % code_size;
+    return code_pc;
+}
+
+void usage(const char *prog)
+{
+    fprintf(stderr, "Usage:\n  %s <pattern> [options]\n"
+                    "Patterns:\n"
+                    "  stream   sequential accesses\n"
+                    "  stride   accesses every -s bytes\n"
+                    "  random   uniform over the working set\n"
+                    "  chase    pointer-chase over the working set\n"
+                    "  zipf     zipfian hot set over the working set\n"
+                    "  mixed    random data interleaved with instructions\n"
+                    "Options:\n"
+                    "  -n <accesses>    (default %llu)\n"
+                    "  -m <working set bytes> (default %llu)\n"
+                    "  -s <stride bytes> (default %llu)\n"
+                    "  -z <access size bytes, a power of two> (default %u)\n"
+                    "  -a <zipf alpha>  (default %.1f)\n"
+                    "  -i <instruction fraction> (default 0, mixed 0.5)\n"
+                    "  -w <write fraction of data> (default %.1f)\n"
+                    "  -r <seed>        (default %llu)\n",
+            prog, count, working_set, stride, size, alpha, w_frac, seed);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const char *pattern = argv[1];
+    if (strcmp(pattern, "mixed") == 0)
+        i_frac = 0.5;
+
+    for (int i = 2; i < argc; i++) {
+        if (argv[i][0] != '-' || argv[i][1] == '\0' || argv[i][2] != '\0' ||
+            i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        const char *value = argv[++i];
+        switch (argv[i - 1][1]) {
+        case 'n': count = strtoull(value, NULL, 0); break;
+        case 'm': working_set = strtoull(value, NULL, 0); break;
+        case 's': stride = strtoull(value, NULL, 0); break;
+        case 'z': size = (unsigned int) strtoul(value, NULL, 0); break;
+        case 'a': alpha = atof(value); break;
+        case 'i': i_frac = atof(value); break;
+        case 'w': w_frac = atof(value); break;
+        case 'r': seed = strtoull(value, NULL, 0); break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // accesses are aligned to their size, so none straddles a line
+    if (working_set < BLOCK || size == 0 || size > BLOCK ||
+        (size & (size - 1)) != 0 || stride == 0) {
+        fprintf(stderr, "%s: need a working set of at least one block,"
+                        " a power of two size of 1-%d bytes and a nonzero"
+                        " stride\n",
+                argv[0], BLOCK);
+        return 1;
+    }
+
+    rng_state = seed ? seed : 1;
+    unsigned long long blocks = working_set / BLOCK;
+    code_pc = code_base;
+
+    int kind;
+    if (strcmp(pattern, "stream") == 0) kind = 0;
+    else if (strcmp(pattern, "stride") == 0) kind = 1;
+    else if (strcmp(pattern, "random") == 0 || strcmp(pattern, "mixed") == 0)
+        kind = 2;
+    else if (strcmp(pattern, "chase") == 0) kind = 3;
+    else if (strcmp(pattern, "zipf") == 0) kind = 4;
+    else {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (kind == 3)
+        chase_init(blocks);
+    else if (kind == 4)
+        zipf_init(blocks);
+
+    addr_t offset = 0;
+    for (unsigned long long n = 0; n < count; n++) {
+        if (i_frac > 0 && rng_uniform() < i_frac) {
+            addr_t pc = next_code();
+            printf("i %llx %llx 4\n", pc, pc);
+            continue;
+        }
+
+        switch (kind) {
+        case 0:
+            offset = (offset + size) % working_set;
+            break;
+        case 1:
+            offset = (offset + stride) % working_set;
+            break;
+        case 2:
+            offset = rng_next() % working_set & ~(addr_t) (size - 1);
+            break;
+        case 3:
+            chase_pos = chase_next[chase_pos];
+            offset = chase_pos * BLOCK;
+            break;
+        case 4:
+            offset = zipf_sample() * BLOCK + rng_next() % (BLOCK / size) * size;
+            break;
+        }
+
+        addr_t addr = data_base + offset;
+        char c = rng_uniform() < w_frac ? 'w' : 'r';
+        printf("%c %llx %llx %u\n", c, addr, addr, size);
+    }
+
+    return 0;
+}
@@ -0,0 +1,93 @@
+/*
+ * lottery.c
+ * Lottery scheduling policy for os-sim, loaded with --sched
+ *
+ * Every ready process holds tickets according to its nice value, from 40
+ * at -20 down to 1 at 19, and each dispatch draws a winning ticket.  Over
+ * time a process gets CPU time in proportion to its tickets, without any
+ * process starving.  A process waking from I/O preempts one holding fewer
+ * tickets, so interactive processes with a good nice value stay responsive.
+ */
+
+#include <stdlib.h>
+
+#include "scheduler.h"
+
+static pcb_t **ready;
+static unsigned int ready_count;
+static unsigned long total_tickets;
+
+/* xorshift64*, seeded with a constant so runs are repeatable */
+static unsigned long long rng_state = 88172645463325252ull;
+
+static unsigned int tickets(const pcb_t *pcb)
+{
+    int nice = pcb->priority;
+
+    if (nice < -20)
+        nice = -20;
+    if (nice > 19)
+        nice = 19;
+    return (unsigned int)(20 - nice);
+}
+
+static unsigned long long rng_next(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ull;
+}
+
+static int lottery_init(unsigned int cpu_count, unsigned int process_count)
+{
+    (void)cpu_count;
+    ready = malloc(sizeof(pcb_t*) * process_count);
+    return ready == NULL;
+}
+
+static void lottery_enqueue(pcb_t *pcb, unsigned int cpu_id)
+{
+    (void)cpu_id;
+    ready[ready_count++] = pcb;
+    total_tickets += tickets(pcb);
+}
+
+static pcb_t *lottery_pick_next(unsigned int cpu_id, int *time_slice)
+{
+    unsigned long winner;
+    unsigned int n;
+    pcb_t *pcb;
+
+    (void)cpu_id;
+    (void)time_slice;
+    if (ready_count == 0)
+        return NULL;
+
+    winner = (unsigned long)(rng_next() % total_tickets);
+    for (n=0; winner >= tickets(ready[n]); n++)
+        winner -= tickets(ready[n]);
+
+    /* The order of the ready processes does not matter */
+    pcb = ready[n];
+    ready[n] = ready[--ready_count];
+    total_tickets -= tickets(pcb);
+    return pcb;
+}
+
+static int lottery_should_preempt(const pcb_t *woken, const pcb_t *running)
+{
+    return tickets(woken) > tickets(running);
+}
+
+const scheduler_ops_t scheduler_ops = {
+    SCHEDULER_ABI_VERSION,
+    "lottery",
+    lottery_init,
+    lottery_enqueue,
+    lottery_pick_next,
+    NULL,
+    NULL,
+    NULL,
+    lottery_should_preempt
+};
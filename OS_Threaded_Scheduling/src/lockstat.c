@@ -0,0 +1,146 @@
+/*
+ * lockstat.c
+ * Multithreaded OS Simulation for ECE 3056
+ *
+ * Lock instrumentation, only compiled in with LOCKSTAT defined.  See
+ * lockstat.h.
+ */
+
+#ifdef LOCKSTAT
+
+#include <stdio.h>
+#include <time.h>
+
+#include "lockstat.h"
+
+static lockstat_t *first_lock = NULL, **last_lock = &first_lock;
+static unsigned long long started_at;
+static unsigned long handoffs;
+static unsigned long long handoff_ns, max_handoff_ns;
+
+/*
+ * wait_since is when the thread started waiting for the lock it is taking,
+ * and shared_since when it took the shared lock it holds, if any.
+ */
+static __thread unsigned long long wait_since, shared_since;
+
+extern unsigned long long lockstat_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ull +
+           (unsigned long long)now.tv_nsec;
+}
+
+extern void lockstat_register(lockstat_t *stat, const char *name,
+                              int instance)
+{
+    if (first_lock == NULL)
+        started_at = lockstat_now();
+
+    stat->name = name;
+    stat->instance = instance;
+    stat->acquisitions = 0;
+    stat->wait_ns = stat->max_wait_ns = 0;
+    stat->hold_ns = stat->max_hold_ns = 0;
+    stat->next = NULL;
+    *last_lock = stat;
+    last_lock = &stat->next;
+}
+
+extern void lockstat_wait(void)
+{
+    wait_since = lockstat_now();
+}
+
+/* account_acquisition() counts an acquisition and returns the time */
+static unsigned long long account_acquisition(lockstat_t *stat)
+{
+    unsigned long long now = lockstat_now(), wait = now - wait_since;
+
+    stat->acquisitions++;
+    stat->wait_ns += wait;
+    if (wait > stat->max_wait_ns)
+        stat->max_wait_ns = wait;
+    return now;
+}
+
+static void account_hold(lockstat_t *stat, unsigned long long since)
+{
+    unsigned long long hold = lockstat_now() - since;
+
+    stat->hold_ns += hold;
+    if (hold > stat->max_hold_ns)
+        stat->max_hold_ns = hold;
+}
+
+extern void lockstat_acquired(lockstat_t *stat)
+{
+    stat->acquired_at = account_acquisition(stat);
+}
+
+extern void lockstat_released(lockstat_t *stat)
+{
+    account_hold(stat, stat->acquired_at);
+}
+
+extern void lockstat_reacquired(lockstat_t *stat)
+{
+    stat->acquired_at = lockstat_now();
+}
+
+extern void lockstat_shared_acquired(lockstat_t *stat)
+{
+    shared_since = account_acquisition(stat);
+}
+
+/* A thread may release a shared lock it never took; see context_switch() */
+extern void lockstat_shared_released(lockstat_t *stat)
+{
+    if (shared_since == 0)
+        return;
+    account_hold(stat, shared_since);
+    shared_since = 0;
+}
+
+extern void lockstat_handoff(unsigned long long signalled)
+{
+    unsigned long long latency = lockstat_now() - signalled;
+
+    handoffs++;
+    handoff_ns += latency;
+    if (latency > max_handoff_ns)
+        max_handoff_ns = latency;
+}
+
+extern void lockstat_report(void)
+{
+    double wall = (double)(lockstat_now() - started_at) / 1e9;
+    char name[32];
+    lockstat_t *stat;
+
+    printf("\nLock statistics over %.3f s of wall time\n", wall);
+    printf("Lock                  Acquired    Wait (ms)  Max wait (us)"
+           "  Hold (ms)  Max hold (us)  Held\n");
+    for (stat=first_lock; stat != NULL; stat=stat->next)
+    {
+        if (stat->instance >= 0)
+            snprintf(name, sizeof(name), "%s %d", stat->name,
+                     stat->instance);
+        else
+            snprintf(name, sizeof(name), "%s", stat->name);
+        printf("%-21s %-11lu %-10.3f %-14.1f %-10.3f %-14.1f %.1f%%\n", name,
+               stat->acquisitions, (double)stat->wait_ns / 1e6,
+               (double)stat->max_wait_ns / 1e3, (double)stat->hold_ns / 1e6,
+               (double)stat->max_hold_ns / 1e3,
+               wall > 0.0 ? (double)stat->hold_ns / 1e9 / wall * 100.0 : 0.0);
+    }
+    /* Virtual time has no CPU threads to hand off to */
+    if (handoffs > 0)
+        printf("CPU hand-offs: %lu, mean latency %.1f us, max %.1f us\n",
+               handoffs, (double)handoff_ns / (double)handoffs / 1e3,
+               (double)max_handoff_ns / 1e3);
+}
+
+#endif /* LOCKSTAT */
@@ -0,0 +1,79 @@
+/*
+ * lockstat.h
+ * Multithreaded OS Simulation for ECE 3056
+ *
+ * Lock instrumentation, built into os-sim-lockstat with make lockstat.
+ * With LOCKSTAT defined, the simulator_mutex, both sides of the
+ * student_lock and the run queue mutexes count their acquisitions and time
+ * how long threads waited for them and held them, and the hand-off of an
+ * event from the supervisor to a CPU thread is timed from the signal to the
+ * wakeup.  The report is printed with the final statistics.
+ *
+ * Instrumentation goes inside IF_LOCKSTAT(), which drops it when LOCKSTAT
+ * is not defined, so a normal build has none of it.
+ */
+
+#ifndef __LOCKSTAT_H__
+#define __LOCKSTAT_H__
+
+#ifdef LOCKSTAT
+
+#define IF_LOCKSTAT(...) __VA_ARGS__
+
+/*
+ * The statistics of one lock.  Times are in nanoseconds.  acquired_at is
+ * the time the holder of an exclusive lock acquired it.
+ */
+typedef struct _lockstat_t {
+    const char *name;
+    int instance;
+    unsigned long acquisitions;
+    unsigned long long wait_ns, max_wait_ns;
+    unsigned long long hold_ns, max_hold_ns;
+    unsigned long long acquired_at;
+    struct _lockstat_t *next;
+} lockstat_t;
+
+/*
+ * lockstat_register() adds a lock to the report, as name or as name
+ * followed by instance if instance is not negative.  Locks must be
+ * registered before the simulation starts.
+ */
+extern void lockstat_register(lockstat_t *stat, const char *name,
+                              int instance);
+
+/*
+ * lockstat_wait() is called just before the calling thread tries to take a
+ * lock, and then lockstat_acquired() once it holds it exclusively.
+ * lockstat_released() is called just before it releases the lock again,
+ * and lockstat_reacquired() when a condition wait gave it back, so that
+ * the time spent in condition waits counts as neither.
+ *
+ * lockstat_shared_acquired() and lockstat_shared_released() are the same
+ * for a lock held by several threads at once.  The calls for one lock
+ * must be serialized, e.g. by its internal mutex.
+ */
+extern void lockstat_wait(void);
+extern void lockstat_acquired(lockstat_t *stat);
+extern void lockstat_released(lockstat_t *stat);
+extern void lockstat_reacquired(lockstat_t *stat);
+extern void lockstat_shared_acquired(lockstat_t *stat);
+extern void lockstat_shared_released(lockstat_t *stat);
+
+/*
+ * lockstat_handoff() accounts one hand-off to a CPU thread that was
+ * signalled at signalled, a time from lockstat_now().
+ */
+extern unsigned long long lockstat_now(void);
+extern void lockstat_handoff(unsigned long long signalled);
+
+/* lockstat_report() prints the statistics of every lock */
+extern void lockstat_report(void);
+
+#else
+
+#define IF_LOCKSTAT(...)
+
+#endif /* LOCKSTAT */
+
+#endif /* __LOCKSTAT_H__ */
@@ -9,11 +9,14 @@
 
 #include <assert.h>
 #include <pthread.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <time.h>
 
+#include "lockstat.h"
 #include "os-sim.h"
 #include "process.h"
 #include "student.h"
@@ -32,39 +35,291 @@ typedef struct {
     simulator_cpu_state_t state;
     pthread_cond_t wakeup;
     int preemption_timer;
+    unsigned int switch_stall, cache_stall;
+    unsigned int ticks_run;
+    unsigned long dispatches;
+    IF_LOCKSTAT(unsigned long long signalled;)
 } simulator_cpu_data_t;
 
-/* The I/O queue is a simple, FIFO queue using a linked list */
+/*
+ * Context switch cost model.  Dispatching a process other than the one that
+ * was just running on a CPU stalls that CPU for switch_cost ticks.  The
+ * process then pays cache_penalty more ticks if its cache is cold: it is
+ * running for the first time, last ran on another CPU, or cache_depth other
+ * processes have been dispatched on this CPU since it last ran there.  A
+ * stalled CPU holds the process in RUNNING without advancing its burst or
+ * its preemption timer.  Both costs default to zero.
+ */
+static unsigned int switch_cost = 0, cache_penalty = 0, cache_depth = 1;
+static int *resident_cpu;
+static unsigned long *resident_dispatch;
+static unsigned long lost_switch_ticks = 0, lost_cache_ticks = 0;
+static unsigned int cold_dispatches = 0, costed_dispatches = 0;
+
+/*
+ * CPU cores.  Each CPU has one or more DVFS levels, the first being the one
+ * it starts at, and runs at one of them.  A level retires speed / 100 ticks
+ * of CPU burst per tick and costs energy millijoules per tick while the CPU
+ * has a process; an idle CPU is power gated and costs nothing.  Partial
+ * ticks of work carry over in credit, in 1/100 ticks, until the burst ends.
+ * Without --cores every CPU has a single level at the nominal speed.
+ */
+typedef struct {
+    unsigned int speed;
+    double energy;
+} cpu_level_t;
+
+typedef struct {
+    cpu_level_t *levels;
+    unsigned int level_count;
+    unsigned int level;
+    unsigned int credit;
+    unsigned long busy_ticks;
+    double energy;
+} cpu_core_t;
+
+#define NOMINAL_SPEED 100
+
+static cpu_core_t *cpu_cores = NULL;
+static unsigned int cpu_core_count = 0;
+static int cpu_cores_configured = 0;
+
+/*
+ * I/O is served by one or more devices.  Process n sends its requests to
+ * device n % io_device_count.  A device has a number of channels that each
+ * serve one request at a time, and a FIFO list of waiting requests.  The
+ * discipline picks the next waiting request when a channel frees up:
+ *
+ *   IO_FIFO           one channel, oldest request first
+ *   IO_SHORTEST_FIRST one channel, shortest request first (like SSTF)
+ *   IO_PARALLEL       several channels, oldest request first
+ *
+ * Requests come from a pool with one request per process, since a process
+ * has at most one outstanding request, so none are allocated per tick.
+ */
+typedef enum {
+    IO_FIFO = 0,
+    IO_SHORTEST_FIRST,
+    IO_PARALLEL
+} io_discipline_t;
+
 typedef struct _io_request {
     pcb_t *pcb;
     unsigned int execution_time;
+    unsigned int submitted;
     struct _io_request *next;
 } io_request;
 
-
-static io_request *io_queue_head = NULL, *io_queue_tail = NULL;
+typedef struct {
+    io_discipline_t discipline;
+    unsigned int channels;
+    io_request **active;
+    io_request *head, *tail;
+    unsigned int completed;
+    unsigned long busy_ticks, wait_ticks;
+} io_device_t;
+
+static io_device_t *io_devices = NULL;
+static unsigned int io_device_count = 0;
+static int io_devices_configured = 0;
+static io_request *io_pool, *io_free_list;
 static simulator_cpu_data_t *simulator_cpu_data;
 static pthread_t *cpu_thread;
 static pthread_mutex_t simulator_mutex;
+IF_LOCKSTAT(static lockstat_t simulator_lockstat;)
 static unsigned int simulator_time = 0;
 static unsigned int processes_terminated = 0;
 static unsigned int cpu_count;
 static unsigned int ready_counter = 0, running_counter = 0, waiting_counter = 0;
 static unsigned int context_switches = 0;
+static unsigned int processes_created = 0;
+
+/*
+ * Per-process accounting for the latency report, indexed by pid.  All
+ * times are in ticks; first_run stays NOT_STARTED until the process is
+ * first dispatched.
+ */
+typedef struct {
+    unsigned int first_run;
+    unsigned int completion;
+    unsigned int ready, running, waiting;
+    unsigned int preemptions;
+} process_stats_t;
+
+#define NOT_STARTED UINT_MAX
+
+/*
+ * The READY/RUNNING/WAITING time is accounted when a process changes
+ * state, not by scanning the process table every tick.  observed_state[]
+ * is the state a process has been accounted in since the tick in
+ * state_since[], and state_count[] the number of processes in each
+ * state.  The student's code changes states only in the handlers, so
+ * switch_process() and call_wake_up() note the processes whose state may
+ * have changed in changed_pids[], and the next tick accounts them.
+ */
+static process_state_t *observed_state;
+static unsigned int *state_since;
+static unsigned int state_count[PROCESS_TERMINATED + 1];
+static unsigned int *changed_pids, changed_count = 0;
+static char *state_changed;
+
+static process_stats_t *process_stats;
+static const char *json_report_path = NULL;
+static int latency_report = 0;
+
+/* Without the Gantt chart, only the final statistics are printed */
+static int gantt_chart = 1;
+
+/*
+ * Periodic processes.  When a job completes, its process waits for the
+ * release of the next job on the sleeping list, ordered by release tick
+ * and linked through next_sleeper[] by pid.  The lateness of every job,
+ * completion minus deadline, is kept for the deadline report, along with
+ * the jobs and misses of each process.
+ */
+#define NO_SLEEPER UINT_MAX
+
+static unsigned int *release_time, *next_sleeper;
+static unsigned int first_sleeper = NO_SLEEPER;
+static unsigned int *jobs_completed, *jobs_missed;
+static int *job_lateness, *job_max_lateness;
+static unsigned int job_count = 0, job_capacity = 0;
+static unsigned int periodic_count = 0;
+
+/*
+ * Virtual time (--fast) replaces the supervisor and CPU threads with a
+ * single-threaded discrete-event loop.  Every event source keeps the tick
+ * of its next event, and the event queue is a binary min-heap of those
+ * ticks.  An entry whose tick no longer matches its source is stale and is
+ * dropped when it reaches the top of the heap.
+ */
+typedef enum {
+    EVENT_CPU = 0,      /* CPU burst completion or preemption timer */
+    EVENT_IO,           /* I/O completion at the head of the I/O queue */
+    EVENT_ARRIVAL,      /* process creation */
+    EVENT_RELEASE,      /* release of a periodic process's next job */
+    EVENT_REPLAY        /* next recorded decision (--replay) */
+} simulator_event_type_t;
+
+typedef struct {
+    unsigned int time;
+    simulator_event_type_t type;
+    unsigned int id;
+} simulator_event_t;
+
+#define NO_EVENT UINT_MAX
+
+static int virtual_time = 0;
+static simulator_event_t *event_heap;
+static unsigned int event_count = 0, event_capacity = 0;
+static unsigned int *cpu_event_time;
+static unsigned int io_event_time = NO_EVENT, arrival_event_time = NO_EVENT;
+static unsigned int release_event_time = NO_EVENT;
+static unsigned int replay_event_time = NO_EVENT;
+
+/*
+ * Recording and replay (--record, --replay).  Every decision the scheduler
+ * makes, a context_switch() or a force_preempt() that takes effect, is
+ * logged with the tick it was made in and its step within the tick.  The
+ * steps count the windows in which the supervisor lets the scheduler run:
+ * the gap before the tick, then each handler and wake_up() call during it.
+ * Idle CPU threads race with the supervisor, and the tick and step pin
+ * down which window their decisions fell in.
+ *
+ * A replay runs in virtual time without calling the scheduler.  At the end
+ * of each window it makes the decisions recorded in it, and changes the
+ * process states the way a scheduler's handlers do.
+ */
+typedef enum {
+    DECISION_SWITCH = 0,    /* context_switch() to a process */
+    DECISION_IDLE,          /* context_switch() to the idle process */
+    DECISION_PREEMPT        /* force_preempt() of a running process */
+} decision_type_t;
+
+typedef struct {
+    unsigned int time, step;
+    decision_type_t type;
+    unsigned int cpu;
+    /* pid and level, the CPU's DVFS level, are set for DECISION_SWITCH */
+    unsigned int pid;
+    int time_slice;
+    unsigned int level;
+} decision_t;
+
+static FILE *record_file = NULL;
+static int replaying = 0;
+static decision_t *replay_log = NULL;
+static unsigned int replay_count = 0, replay_next = 0;
+static unsigned int replay_cpu_count, replay_process_count;
+static unsigned int sync_step = 0;
 
 static void simulator_supervisor_thread(void);
+static void simulator_event_loop(void);
+static void lock_simulator(void);
+static void unlock_simulator(void);
+static void wait_simulator(pthread_cond_t *cond);
 static void simulator_cpu_thread(unsigned int cpu_id);
 
 int nanosleep(const struct timespec *rqtp, struct timespec *rmtp);
 
 static void print_gantt_header(void);
-static void print_gantt_line(void);static void print_final_stats(void);
+static void print_gantt_line(void);
+static void count_process_states(unsigned int *running, unsigned int *ready,
+                                 unsigned int *waiting);
+static void note_state_change(const pcb_t *pcb);
+static void account_state_changes(void);
+static void print_gantt_row(unsigned int running, unsigned int ready,
+                            unsigned int waiting);
+static void print_final_stats(void);
+static void print_switch_cost_stats(void);
+static void charge_switch_cost(unsigned int cpu_id, pcb_t *pcb);
+static unsigned int consume_stall(unsigned int cpu_id, unsigned int ticks);
+static void retire_work(unsigned int cpu_id, op_t *pc, unsigned int ticks);
+static unsigned int ticks_to_retire(unsigned int cpu_id, unsigned int work);
+static void account_energy(unsigned int cpu_id, unsigned int ticks);
+static void print_energy_stats(void);
+static void print_latency_report(void);
+static void write_json_report(const char *path);
+static unsigned int percentile(unsigned int *values, unsigned int count,
+                               unsigned int p);
+static int compare_uint(const void *a, const void *b);
 
 static void simulate_cpus(void);
 static void simulate_process(unsigned int cpu_id, pcb_t *pcb);
 static void submit_io_request(pcb_t *pcb, unsigned int execution_time);
 static void simulate_io(void);
+static void start_io_requests(io_device_t *device);
+static void print_io_stats(void);
 static void simulate_creat(void);
+static void complete_job(pcb_t *pcb);
+static void sleep_until_release(pcb_t *pcb);
+static void simulate_releases(void);
+static void print_deadline_report(void);
+static void print_thread_report(void);
+static int compare_int(const void *a, const void *b);
+static void raise_cpu_event(unsigned int cpu_id, simulator_cpu_state_t state);
+
+static void run_cpu_handler(unsigned int cpu_id);
+static void dispatch_idle_cpus(void);
+static void skip_ticks(unsigned int ticks);
+static void schedule_events(void);
+static void push_event(simulator_event_type_t type, unsigned int id,
+                       unsigned int time);
+static void switch_process(unsigned int cpu_id, pcb_t *pcb,
+                           int preemption_time);
+static void call_wake_up(pcb_t *pcb);
+static void sync_decisions(void);
+static int apply_decision(const decision_t *d);
+static void replay_cpu_event(unsigned int cpu_id,
+                             simulator_cpu_state_t state);
+static void replay_diverged(const char *reason, const decision_t *d);
+static void record_decision(decision_type_t type, unsigned int cpu_id,
+                            const pcb_t *pcb, int time_slice);
+static void print_decision(FILE *file, const decision_t *d);
+static int load_recording(const char *path, decision_t **log,
+                          unsigned int *count, unsigned int *cpus,
+                          unsigned int *processes_recorded);
+static unsigned int next_event_time(void);
 
 static void* simulator_cpu_thread_func(void *data);
 
@@ -90,28 +345,37 @@ typedef struct {
     pthread_mutex_t mutex;
     pthread_cond_t no_writers;
     int writers;
+    IF_LOCKSTAT(lockstat_t reader_stat, writer_stat;)
 } irwl;
 
 #define IRWL_INIT(i) \
     pthread_mutex_init(&(i).mutex, NULL); \
     pthread_cond_init(&(i).no_writers, NULL); \
-    (i).writers = 0;
+    (i).writers = 0; \
+    IF_LOCKSTAT(lockstat_register(&(i).reader_stat, #i " reader", -1);) \
+    IF_LOCKSTAT(lockstat_register(&(i).writer_stat, #i " writers", -1);)
 
 #define IRWL_READER_LOCK(i) \
+    IF_LOCKSTAT(lockstat_wait();) \
     pthread_mutex_lock(&(i).mutex); \
     while ((i).writers > 0) \
-    { pthread_cond_wait(&(i).no_writers, &(i).mutex); }
+    { pthread_cond_wait(&(i).no_writers, &(i).mutex); } \
+    IF_LOCKSTAT(lockstat_acquired(&(i).reader_stat);)
 
 #define IRWL_READER_UNLOCK(i) \
+    IF_LOCKSTAT(lockstat_released(&(i).reader_stat);) \
     pthread_mutex_unlock(&(i).mutex);
 
 #define IRWL_WRITER_LOCK(i) \
+    IF_LOCKSTAT(lockstat_wait();) \
     pthread_mutex_lock(&(i).mutex); \
     (i).writers++; \
+    IF_LOCKSTAT(lockstat_shared_acquired(&(i).writer_stat);) \
     pthread_mutex_unlock(&(i).mutex);
 
 #define IRWL_WRITER_UNLOCK(i) \
     pthread_mutex_lock(&(i).mutex); \
+    IF_LOCKSTAT(lockstat_shared_released(&(i).writer_stat);) \
     (i).writers--; \
     if ((i).writers == 0) \
     { pthread_cond_signal(&(i).no_writers); } \
@@ -120,6 +384,31 @@ typedef struct {
 static irwl student_lock;
 
 
+/*
+ * lock_simulator(), unlock_simulator() and wait_simulator() lock, unlock
+ * and wait on the simulator_mutex, keeping its statistics with LOCKSTAT.
+ */
+static void lock_simulator(void)
+{
+    IF_LOCKSTAT(lockstat_wait();)
+    pthread_mutex_lock(&simulator_mutex);
+    IF_LOCKSTAT(lockstat_acquired(&simulator_lockstat);)
+}
+
+static void unlock_simulator(void)
+{
+    IF_LOCKSTAT(lockstat_released(&simulator_lockstat);)
+    pthread_mutex_unlock(&simulator_mutex);
+}
+
+static void wait_simulator(pthread_cond_t *cond)
+{
+    IF_LOCKSTAT(lockstat_released(&simulator_lockstat);)
+    pthread_cond_wait(cond, &simulator_mutex);
+    IF_LOCKSTAT(lockstat_reacquired(&simulator_lockstat);)
+}
+
+
 /* The big initialization function */
 extern void start_simulator(unsigned int new_cpu_count)
 {
@@ -127,9 +416,9 @@ extern void start_simulator(unsigned int new_cpu_count)
 
     /* Make sure the # of CPUs is reasonable */
     cpu_count = new_cpu_count;
-    if (cpu_count < 1 || cpu_count > 16)
+    if (cpu_count < 1)
     {
-        fprintf(stderr, "CPU Count must be an integer from 1 to 16!\n\n");
+        fprintf(stderr, "CPU Count must be a positive integer!\n\n");
         exit(-1);
     }
 
@@ -142,17 +431,114 @@ extern void start_simulator(unsigned int new_cpu_count)
 
     /* Initialize mutexes and condition variables */
     pthread_mutex_init(&simulator_mutex, NULL);
+    IF_LOCKSTAT(lockstat_register(&simulator_lockstat, "simulator_mutex", -1);)
     simulator_time = 0;
     for (n=0; n<cpu_count; n++)
     {
         simulator_cpu_data[n].current = NULL;
         simulator_cpu_data[n].state = CPU_IDLE;
         simulator_cpu_data[n].preemption_timer = -1;
+        simulator_cpu_data[n].switch_stall = 0;
+        simulator_cpu_data[n].cache_stall = 0;
+        simulator_cpu_data[n].dispatches = 0;
         pthread_cond_init(&simulator_cpu_data[n].wakeup, NULL);
     }
 
     IRWL_INIT(student_lock)
 
+    /* Default to nominal speed cores, without their statistics */
+    if (cpu_cores == NULL)
+    {
+        cpu_cores = calloc(cpu_count, sizeof(cpu_core_t));
+        assert(cpu_cores != NULL);
+        cpu_core_count = cpu_count;
+        for (n=0; n<cpu_count; n++)
+        {
+            cpu_cores[n].levels = malloc(sizeof(cpu_level_t));
+            assert(cpu_cores[n].levels != NULL);
+            cpu_cores[n].levels[0].speed = NOMINAL_SPEED;
+            cpu_cores[n].levels[0].energy = 0.0;
+            cpu_cores[n].level_count = 1;
+        }
+    }
+    else if (cpu_core_count != cpu_count)
+    {
+        fprintf(stderr, "--cores describes %u CPUs, but there are %u!\n\n",
+                cpu_core_count, cpu_count);
+        exit(-1);
+    }
+
+    /* Default to the single FIFO I/O device, without its statistics */
+    if (io_device_count == 0)
+    {
+        simulator_set_io_devices("fifo");
+        io_devices_configured = 0;
+    }
+    io_pool = malloc(sizeof(io_request) * process_count);
+    assert(io_pool != NULL);
+    io_free_list = NULL;
+    for (n=0; n<process_count; n++)
+    {
+        io_pool[n].next = io_free_list;
+        io_free_list = &io_pool[n];
+    }
+
+    process_stats = calloc(process_count, sizeof(process_stats_t));
+    assert(process_stats != NULL);
+    for (n=0; n<process_count; n++)
+        process_stats[n].first_run = NOT_STARTED;
+
+    observed_state = calloc(process_count, sizeof(process_state_t));
+    state_since = calloc(process_count, sizeof(unsigned int));
+    changed_pids = malloc(sizeof(unsigned int) * process_count);
+    state_changed = calloc(process_count, 1);
+    assert(observed_state != NULL && state_since != NULL &&
+           changed_pids != NULL && state_changed != NULL);
+    state_count[PROCESS_NEW] = process_count;
+
+    release_time = malloc(sizeof(unsigned int) * process_count);
+    next_sleeper = malloc(sizeof(unsigned int) * process_count);
+    jobs_completed = calloc(process_count, sizeof(unsigned int));
+    jobs_missed = calloc(process_count, sizeof(unsigned int));
+    job_max_lateness = calloc(process_count, sizeof(int));
+    assert(release_time != NULL && next_sleeper != NULL &&
+           jobs_completed != NULL && jobs_missed != NULL &&
+           job_max_lateness != NULL);
+    for (n=0; n<process_count; n++)
+    {
+        release_time[n] = processes[n].arrival;
+        if (processes[n].period > 0)
+            periodic_count++;
+    }
+
+    if (replaying && (replay_cpu_count != cpu_count ||
+                      replay_process_count != process_count))
+    {
+        fprintf(stderr, "The recording is of %u CPUs and %u processes, not"
+                " %u and %u!\n\n", replay_cpu_count, replay_process_count,
+                cpu_count, process_count);
+        exit(-1);
+    }
+    if (record_file != NULL)
+        fprintf(record_file, "# os-sim recording: %u CPUs, %u processes\n"
+                "# <tick> <step> switch <cpu> <pid> <time slice> <level>"
+                " | idle <cpu> | preempt <cpu>\n", cpu_count, process_count);
+
+    resident_cpu = malloc(sizeof(int) * process_count);
+    resident_dispatch = calloc(process_count, sizeof(unsigned long));
+    assert(resident_cpu != NULL && resident_dispatch != NULL);
+    for (n=0; n<process_count; n++)
+        resident_cpu[n] = -1;
+
+    if (virtual_time)
+    {
+        cpu_event_time = malloc(sizeof(unsigned int) * cpu_count);
+        assert(cpu_event_time != NULL);
+        for (n=0; n<cpu_count; n++)
+            cpu_event_time[n] = NO_EVENT;
+        simulator_event_loop();
+    }
+
     /* Start CPU threads */
     for (n=0; n<cpu_count; n++)
         pthread_create(&cpu_thread[n], NULL, simulator_cpu_thread_func,
@@ -176,21 +562,24 @@ static void simulator_supervisor_thread(void)
        display a line in the Gantt chart and check for pending I/O requests */
     while (1)
     {
-        pthread_mutex_lock(&simulator_mutex);
+        lock_simulator();
 
         /* Exit when all processes terminate */
-        if (processes_terminated >= PROCESS_COUNT)
+        if (processes_terminated >= process_count)
         {
             print_final_stats();
             exit(0);
         }
 
+        sync_decisions();
         print_gantt_line();
         simulate_cpus();
         simulate_io();
+        simulate_releases();
         simulate_creat();
         simulator_time++;
-        pthread_mutex_unlock(&simulator_mutex);
+        sync_step = 0;
+        unlock_simulator();
 
         mt_safe_usleep(1);
     }
@@ -227,7 +616,7 @@ static void simulator_cpu_thread(unsigned int cpu_id)
 
     while (1)
     {
-        pthread_mutex_lock(&simulator_mutex);
+        lock_simulator();
 
         /* Let the simulator know the scheduler has been run */
         pthread_cond_signal(&simulator_cpu_data[cpu_id].wakeup);
@@ -243,11 +632,12 @@ static void simulator_cpu_thread(unsigned int cpu_id)
             simulator_cpu_data[cpu_id].state = CPU_RUNNING;
 
             while (simulator_cpu_data[cpu_id].state == CPU_RUNNING)
-                pthread_cond_wait(&simulator_cpu_data[cpu_id].wakeup,
-                    &simulator_mutex);
+                wait_simulator(&simulator_cpu_data[cpu_id].wakeup);
+            IF_LOCKSTAT(
+                lockstat_handoff(simulator_cpu_data[cpu_id].signalled);)
         }
         state = simulator_cpu_data[cpu_id].state;
-        pthread_mutex_unlock(&simulator_mutex);
+        unlock_simulator();
 
         /* Call student's code */
         switch (state)
@@ -273,9 +663,9 @@ static void simulator_cpu_thread(unsigned int cpu_id)
             break;
 
         case CPU_TERMINATE:
-            pthread_mutex_lock(&simulator_mutex);
+            lock_simulator();
             processes_terminated++;
-            pthread_mutex_unlock(&simulator_mutex);
+            unlock_simulator();
             IRWL_WRITER_LOCK(student_lock)
             terminate(cpu_id);
             IRWL_WRITER_UNLOCK(student_lock)
@@ -298,6 +688,8 @@ static void print_gantt_header(void)
 {
     unsigned int n;
 
+    if (!gantt_chart)
+        return;
     printf("Time  Ru Re Wa     ");
     for (n=0; n<cpu_count; n++)
         printf(" CPU %d   ", n);
@@ -310,40 +702,96 @@ static void print_gantt_header(void)
 
 static void print_gantt_line(void)
 {
-    io_request *r;
-    unsigned int current_ready = 0, current_running = 0, current_waiting = 0;
-    unsigned int n;
+    unsigned int current_ready, current_running, current_waiting;
 
+    count_process_states(&current_running, &current_ready, &current_waiting);
+    print_gantt_row(current_running, current_ready, current_waiting);
+}
 
-    /*
-     * Update number of processes in each state.
-     */
+/*
+ * count_process_states() accounts the state changes since the last tick
+ * and returns the number of processes in each state.
+ */
+static void count_process_states(unsigned int *running, unsigned int *ready,
+                                 unsigned int *waiting)
+{
     IRWL_READER_LOCK(student_lock)
-    for (n=0; n<PROCESS_COUNT; n++)
+    account_state_changes();
+    IRWL_READER_UNLOCK(student_lock)
+
+    *running = state_count[PROCESS_RUNNING];
+    *ready = state_count[PROCESS_READY];
+    *waiting = state_count[PROCESS_WAITING];
+}
+
+/*
+ * note_state_change() has the state of pcb accounted at the next tick.
+ * Must be called with the simulator_mutex held.
+ */
+static void note_state_change(const pcb_t *pcb)
+{
+    if (pcb == NULL || state_changed[pcb->pid])
+        return;
+    state_changed[pcb->pid] = 1;
+    changed_pids[changed_count++] = pcb->pid;
+}
+
+/*
+ * account_state_changes() charges the time a noted process spent in its
+ * previous state, from the tick it entered it up to this one, to the
+ * READY/RUNNING/WAITING totals, globally and per process.
+ */
+static void account_state_changes(void)
+{
+    unsigned int n, pid, ticks;
+    process_state_t state;
+
+    for (n=0; n<changed_count; n++)
     {
-        switch(processes[n].state)
+        pid = changed_pids[n];
+        state_changed[pid] = 0;
+        state = processes[pid].state;
+        if (state == observed_state[pid])
+            continue;
+
+        ticks = simulator_time - state_since[pid];
+        switch (observed_state[pid])
         {
         case PROCESS_READY:
-            current_ready++;
-            ready_counter++;
+            ready_counter += ticks;
+            process_stats[pid].ready += ticks;
             break;
 
         case PROCESS_RUNNING:
-            current_running++;
-            running_counter++;
+            running_counter += ticks;
+            process_stats[pid].running += ticks;
             break;
 
         case PROCESS_WAITING:
-            current_waiting++;
-            waiting_counter++;
+            waiting_counter += ticks;
+            process_stats[pid].waiting += ticks;
             break;
 
         default:
             break;
         }
+        state_count[observed_state[pid]]--;
+        state_count[state]++;
+        observed_state[pid] = state;
+        state_since[pid] = simulator_time;
     }
-    IRWL_READER_UNLOCK(student_lock)
+    changed_count = 0;
+}
+
+static void print_gantt_row(unsigned int current_running,
+                            unsigned int current_ready,
+                            unsigned int current_waiting)
+{
+    io_request *r;
+    unsigned int n, d, c;
 
+    if (!gantt_chart)
+        return;
 
     /* Print time */
     printf("%-5.1f %-2d %-2d %-2d     ", (float)simulator_time / 10.0,
@@ -358,260 +806,1527 @@ static void print_gantt_line(void)
             printf(" (IDLE)  ");
     }
 
-    /* Print I/O requests */
+    /* Print I/O requests, the ones in service first, device by device */
     printf("     <");
-    r = io_queue_head;
-    while (r != NULL)
+    for (d=0; d<io_device_count; d++)
     {
-        printf(" %s", r->pcb->name);
-        r = r->next;
+        if (d > 0)
+            printf(" |");
+        for (c=0; c<io_devices[d].channels; c++)
+            if (io_devices[d].active[c] != NULL)
+                printf(" %s", io_devices[d].active[c]->pcb->name);
+        for (r=io_devices[d].head; r != NULL; r=r->next)
+            printf(" %s", r->pcb->name);
     }
     printf(" <\n");
 }
 
 static void print_final_stats(void)
 {
+    unsigned int n;
+
+    /* Account the last state changes, which no tick did */
+    for (n=0; n<process_count; n++)
+        note_state_change(&processes[n]);
+    account_state_changes();
+
     printf("\n\n");
     printf("# of Context Switches: %u\n", context_switches);
     printf("Total execution time: %.1f s\n", (float)simulator_time / 10.0);
     printf("Total time spent in READY state: %.1f s\n", (float)ready_counter / 10.0);
+    if (switch_cost > 0 || cache_penalty > 0)
+        print_switch_cost_stats();
+    if (cpu_cores_configured)
+        print_energy_stats();
+    if (replaying)
+    {
+        printf("Replayed %u decisions\n", replay_next);
+        if (replay_next < replay_count)
+            fprintf(stderr, "Replay diverged from the recording: %u decisions"
+                    " were never reached\n", replay_count - replay_next);
+    }
+    else
+        print_scheduler_stats();
+    if (io_devices_configured)
+        print_io_stats();
+    if (latency_report)
+        print_latency_report();
+    if (periodic_count > 0)
+        print_deadline_report();
+    for (n=0; n<process_count; n++)
+        if (processes[n].tgid != processes[n].pid)
+        {
+            print_thread_report();
+            break;
+        }
+    if (json_report_path != NULL)
+        write_json_report(json_report_path);
+    IF_LOCKSTAT(lockstat_report();)
 }
 
-
-
 /*
- * context_switch() and force_preempt() are the two functions available to
- * student's code.
+ * print_switch_cost_stats() reports the CPU time lost to switch overhead
+ * and cache refills, and how many dispatches found a cold cache.
  */
-extern void context_switch(unsigned int cpu_id, pcb_t *pcb,
-                           int preemption_time)
+static void print_switch_cost_stats(void)
 {
-    assert(cpu_id < cpu_count);
-    assert(pcb == NULL || (pcb >= processes && pcb <= processes +
-        PROCESS_COUNT - 1));
-
-    context_switches++;
-
-    IRWL_WRITER_UNLOCK(student_lock);
-    pthread_mutex_lock(&simulator_mutex);
-    simulator_cpu_data[cpu_id].current = pcb;
-    simulator_cpu_data[cpu_id].preemption_timer = preemption_time;
-    pthread_mutex_unlock(&simulator_mutex);
-    IRWL_WRITER_LOCK(student_lock);
+    printf("Lost CPU time: %.1f s (switch overhead %.1f s, cache refill"
+           " %.1f s)\n", (float)(lost_switch_ticks + lost_cache_ticks) / 10.0,
+           (float)lost_switch_ticks / 10.0, (float)lost_cache_ticks / 10.0);
+    printf("Cold cache dispatches: %u of %u\n", cold_dispatches,
+           costed_dispatches);
 }
 
-extern void force_preempt(unsigned int cpu_id)
+/*
+ * print_energy_stats() reports the energy used, in total, per second of
+ * makespan and per CPU.
+ */
+static void print_energy_stats(void)
 {
-    assert(cpu_id < cpu_count);
+    double energy = 0.0;
+    unsigned int n, l;
+    char levels[64];
+    int length;
 
-    IRWL_WRITER_UNLOCK(student_lock);
-    pthread_mutex_lock(&simulator_mutex);
+    for (n=0; n<cpu_count; n++)
+        energy += cpu_cores[n].energy;
+    printf("Energy: %.3f J, %.3f J per s of makespan\n", energy / 1000.0,
+           simulator_time ? energy / 1000.0 / ((double)simulator_time / 10.0)
+                          : 0.0);
 
-    /*
-     * It is possible that the student's code calls force_preempt() at the
-     * same time the process was already going to yield or terminate.  We
-     * check for that case by only preempting if the CPU is set to CPU_RUNNING.
-     */
-    if (simulator_cpu_data[cpu_id].state == CPU_RUNNING)
+    printf("\nCPU  Speeds           Busy (s)  Energy (J)\n");
+    for (n=0; n<cpu_count; n++)
     {
-        simulator_cpu_data[cpu_id].state = CPU_PREEMPT;
-        pthread_cond_signal(&simulator_cpu_data[cpu_id].wakeup);
-
-        /* Ensure the scheduler gets run before the simulator */
-        pthread_cond_wait(&simulator_cpu_data[cpu_id].wakeup,
-            &simulator_mutex);
+        length = 0;
+        levels[0] = '\0';
+        for (l=0; l<cpu_cores[n].level_count && length < (int)sizeof(levels);
+             l++)
+            length += snprintf(levels + length, sizeof(levels) - (size_t)length,
+                               "%s%u", l ? "/" : "",
+                               cpu_cores[n].levels[l].speed);
+        printf("%-4u %-16s %-9.1f %.3f\n", n, levels,
+               (double)cpu_cores[n].busy_ticks / 10.0,
+               cpu_cores[n].energy / 1000.0);
     }
+}
 
-    pthread_mutex_unlock(&simulator_mutex);
-    IRWL_WRITER_LOCK(student_lock);
+/*
+ * The latency report groups processes into classes by the first character
+ * of their name, which is I (I/O-bound) or C (CPU-bound) in the built-in
+ * and generated workloads.  Response time runs from arrival to the first
+ * dispatch, turnaround from arrival to completion, and waiting time is the
+ * time spent READY.
+ */
+static unsigned int percentile(unsigned int *values, unsigned int count,
+                               unsigned int p)
+{
+    unsigned int rank;
+
+    if (count == 0)
+        return 0;
+    qsort(values, count, sizeof(unsigned int), compare_uint);
+    /* Nearest rank */
+    rank = (p * count + 99) / 100;
+    return values[rank ? rank - 1 : 0];
 }
 
+static int compare_uint(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int*)a, y = *(const unsigned int*)b;
 
+    return x < y ? -1 : x > y;
+}
 
 /*
- * The functions below are used by the supervisor thread to simulate the OS.
- *
- * simulate_cpus() / simulate_process() simulate the processes on each CPU
- *   and signal the appropriate CPU thread if an event occurs.
- *
- * submit_io_request() inserts a PCB into tail of the I/O queue.
- *
- * simulate_io() simulates the I/O request at the head of the I/O queue and
- *   calls wake_up() upon completion.
- *
- * simulate_creat() simulates initial process creation by calling the
- *   student's wake_up().
+ * latency_class_t holds the p50/p95/p99 of one class, in ticks.
  */
+typedef struct {
+    char name;
+    unsigned int count;
+    unsigned int response[3], turnaround[3], waiting[3];
+} latency_class_t;
 
-static void simulate_cpus(void)
+static const unsigned int percentiles[3] = { 50, 95, 99 };
+
+/*
+ * compute_latency_classes() fills classes[] with one entry per class in
+ * order of first appearance, followed by one for all processes (name 0),
+ * and returns the number of entries.
+ */
+static unsigned int compute_latency_classes(latency_class_t *classes)
 {
-    unsigned int n;
+    unsigned int *response, *turnaround, *waiting;
+    unsigned int class_count = 0, c, n, k, count;
+    char name;
 
-    for (n=0; n<cpu_count; n++)
+    response = malloc(sizeof(unsigned int) * process_count);
+    turnaround = malloc(sizeof(unsigned int) * process_count);
+    waiting = malloc(sizeof(unsigned int) * process_count);
+    assert(response != NULL && turnaround != NULL && waiting != NULL);
+
+    for (n=0; n<process_count; n++)
     {
-        if (simulator_cpu_data[n].current != NULL)
-            simulate_process(n, simulator_cpu_data[n].current);
+        for (c=0; c<class_count; c++)
+            if (classes[c].name == processes[n].name[0])
+                break;
+        if (c == class_count)
+            classes[class_count++].name = processes[n].name[0];
     }
-}
-
-static void simulate_process(unsigned int cpu_id, pcb_t *pcb)
-{
-    /*
-     * The "program counter" is really just a pointer to the current position
-     * in the operations array
-     */
-    op_t *pc = (op_t*)pcb->pc;
+    classes[class_count++].name = '\0';
 
-    switch (pc->type)
+    for (c=0; c<class_count; c++)
     {
-    case OP_CPU:
-        /* Scheduling a running process ... good ... */
-
-        /* Check to see if the CPU burst has completed */
-        if (pc->time > 0)
+        name = classes[c].name;
+        count = 0;
+        for (n=0; n<process_count; n++)
         {
-            /* Simulate running the process */
-            pc->time--;
-            pcb->time_remaining = pc->time + 1;
-            /* Simulate the preemption timer */
-            simulator_cpu_data[cpu_id].preemption_timer--;
-            if (simulator_cpu_data[cpu_id].preemption_timer == 0)
-            {
-                /* The timer has expired; preempt the running process */
-                simulator_cpu_data[cpu_id].state = CPU_PREEMPT;
-                pthread_cond_signal(&simulator_cpu_data[cpu_id].wakeup);
-
-                /* Ensure the scheduler gets run before the simulator */
-                pthread_cond_wait(&simulator_cpu_data[cpu_id].wakeup,
-                    &simulator_mutex);
-            }
+            if (name != '\0' && processes[n].name[0] != name)
+                continue;
+            response[count] = process_stats[n].first_run -
+                              processes[n].arrival;
+            turnaround[count] = process_stats[n].completion -
+                                processes[n].arrival;
+            waiting[count] = process_stats[n].ready;
+            count++;
         }
-        else
+        classes[c].count = count;
+        for (k=0; k<3; k++)
         {
-            /* Move to the next operation */
-            pcb->pc=((op_t*)(pcb->pc))+1;
-            pc++;
-            pcb->time_remaining = pcb->pc->time + 1;
-            switch (pc->type)
-            {
-            case OP_IO:
-                /* Put a request in the I/O FIFO queue */
-                submit_io_request(pcb, pc->time);
-
-                /* Generate a yield() call on the appropriate CPU */
-                simulator_cpu_data[cpu_id].state = CPU_YIELD;
-                pthread_cond_signal(&simulator_cpu_data[cpu_id].wakeup);
-
-                /* Ensure the scheduler gets run before the simulator */
-                pthread_cond_wait(&simulator_cpu_data[cpu_id].wakeup,
-                    &simulator_mutex);
-
-                break;
-
-            case OP_TERMINATE:
-                /* Generate a terminate() call on the appropriate CPU */
-                simulator_cpu_data[cpu_id].state = CPU_TERMINATE;
-                pthread_cond_signal(&simulator_cpu_data[cpu_id].wakeup);
+            classes[c].response[k] = percentile(response, count,
+                                                percentiles[k]);
+            classes[c].turnaround[k] = percentile(turnaround, count,
+                                                  percentiles[k]);
+            classes[c].waiting[k] = percentile(waiting, count,
+                                               percentiles[k]);
+        }
+    }
 
-                /* Ensure the scheduler gets run before the simulator */
-                pthread_cond_wait(&simulator_cpu_data[cpu_id].wakeup,
-                    &simulator_mutex);
+    free(response);
+    free(turnaround);
+    free(waiting);
+    return class_count;
+}
 
-                break;
+static void print_latency_report(void)
+{
+    latency_class_t *classes;
+    unsigned int class_count, c, n;
+    unsigned long long turnaround = 0;
+
+    classes = malloc(sizeof(latency_class_t) * (process_count + 1));
+    assert(classes != NULL);
+    class_count = compute_latency_classes(classes);
+
+    printf("\n%-14s%-22s%-22s%s\n", "", "Response (s)", "Turnaround (s)",
+           "Waiting (s)");
+    printf("Class  Count     p50    p95    p99     p50    p95    p99"
+           "     p50    p95    p99\n");
+    for (c=0; c<class_count; c++)
+    {
+        if (classes[c].name != '\0')
+            printf("%-6c ", classes[c].name);
+        else
+            printf("%-6s ", "all");
+        printf("%-6u %6.1f %6.1f %6.1f  %6.1f %6.1f %6.1f  %6.1f %6.1f %6.1f\n",
+               classes[c].count,
+               classes[c].response[0] / 10.0, classes[c].response[1] / 10.0,
+               classes[c].response[2] / 10.0,
+               classes[c].turnaround[0] / 10.0,
+               classes[c].turnaround[1] / 10.0,
+               classes[c].turnaround[2] / 10.0,
+               classes[c].waiting[0] / 10.0, classes[c].waiting[1] / 10.0,
+               classes[c].waiting[2] / 10.0);
+    }
+    free(classes);
 
-            case OP_CPU:
-                break;
-            }
-        }
-        break;
+    for (n=0; n<process_count; n++)
+        turnaround += process_stats[n].completion - processes[n].arrival;
+    printf("Mean turnaround time: %.1f s\n",
+           process_count ? (double)turnaround / process_count / 10.0 : 0.0);
+}
 
-    case OP_IO:
-        /* Scheduling a process that's blocked on I/O */
-        printf("Scheduled a process that's blocked on I/0! PID: %d\n", pcb->pid);
-        break;
+static int compare_int(const void *a, const void *b)
+{
+    int x = *(const int*)a, y = *(const int*)b;
 
-    case OP_TERMINATE:
-        /* Scheduling a process that's terminated */
-        printf("Scheduled a terminated process! PID: %d\n", pcb->pid);
-        break;
-    }
+    return x < y ? -1 : x > y;
 }
 
-static void submit_io_request(pcb_t *pcb, unsigned int execution_time)
+/*
+ * print_deadline_report() reports the deadline misses of the periodic
+ * processes and the distribution of the lateness of their jobs.  Negative
+ * lateness means the job completed early.
+ */
+static void print_deadline_report(void)
 {
-    io_request *r;
+    unsigned int missed = 0, n, k;
 
-    /* Build I/O Request */
-    r = malloc(sizeof(io_request));
-    assert(r != NULL);
-    r->pcb = pcb;
-    r->execution_time = execution_time;
-    r->next = NULL;
+    for (n=0; n<process_count; n++)
+        missed += jobs_missed[n];
+    printf("\nReal-time jobs: %u, %u missed their deadline (%.1f%%)\n",
+           job_count, missed, job_count ? 100.0 * missed / job_count : 0.0);
 
-    /* Add request to head of queue */
-    if (io_queue_tail != NULL)
+    if (job_count > 0)
     {
-        io_queue_tail->next = r;
-        io_queue_tail = r;
+        qsort(job_lateness, job_count, sizeof(int), compare_int);
+        /* Nearest rank, as in percentile() */
+        printf("Lateness (s):");
+        for (k=0; k<3; k++)
+            printf(" p%u %.1f,", percentiles[k],
+                   job_lateness[(percentiles[k] * job_count + 99) / 100 - 1]
+                   / 10.0);
+        printf(" max %.1f\n", job_lateness[job_count - 1] / 10.0);
     }
-    else
+
+    printf("\nProcess   Period  Deadline  Jobs  Missed  Max lateness (s)\n");
+    for (n=0; n<process_count; n++)
     {
-        io_queue_head = r;
-        io_queue_tail = r;
+        if (processes[n].period == 0)
+            continue;
+        printf("%-9s %-7.1f %-9.1f %-5u %-7u %.1f\n", processes[n].name,
+               processes[n].period / 10.0,
+               processes[n].relative_deadline / 10.0, jobs_completed[n],
+               jobs_missed[n], job_max_lateness[n] / 10.0);
     }
 }
 
-static void simulate_io(void)
+/*
+ * print_thread_report() reports the processes with more than one thread.
+ * A process completes with its last thread.  Its parallelism is the CPU
+ * time of its threads over the time from its first dispatch to completion,
+ * so a process that kept k CPUs busy has a parallelism of k.
+ */
+static void print_thread_report(void)
+{
+    unsigned int n, t, threads, first_run, completion;
+    unsigned long running;
+
+    printf("\nProcess   Threads  Turnaround (s)  Parallelism\n");
+    for (n=0; n<process_count; n=t)
+    {
+        first_run = process_stats[n].first_run;
+        completion = process_stats[n].completion;
+        running = 0;
+        for (t=n; t<process_count && processes[t].tgid == n; t++)
+        {
+            if (process_stats[t].first_run < first_run)
+                first_run = process_stats[t].first_run;
+            if (process_stats[t].completion > completion)
+                completion = process_stats[t].completion;
+            running += process_stats[t].running;
+        }
+        threads = t - n;
+        if (threads < 2)
+            continue;
+        printf("%-9s %-8u %-15.1f %.2f\n", processes[n].name, threads,
+               (completion - processes[n].arrival) / 10.0,
+               completion > first_run ? (double)running /
+                                        (completion - first_run) : 0.0);
+    }
+}
+
+/* print_json_string() prints a JSON string literal */
+static void print_json_string(FILE *file, const char *s)
+{
+    fputc('"', file);
+    for (; *s != '\0'; s++)
+    {
+        if (*s == '"' || *s == '\\')
+            fprintf(file, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(file, "\\u%04x", (unsigned int)(unsigned char)*s);
+        else
+            fputc(*s, file);
+    }
+    fputc('"', file);
+}
+
+static void print_json_percentiles(FILE *file, const char *key,
+                                   const unsigned int *values)
+{
+    fprintf(file, "\"%s\": {\"p50\": %.1f, \"p95\": %.1f, \"p99\": %.1f}",
+            key, values[0] / 10.0, values[1] / 10.0, values[2] / 10.0);
+}
+
+/*
+ * write_json_report() writes the final statistics, the latency classes and
+ * the per-process accounting to path.  Times are in seconds.
+ */
+static void write_json_report(const char *path)
+{
+    latency_class_t *classes;
+    unsigned int class_count, c, n;
+    process_stats_t *ps;
+    char name[2] = { 0, 0 };
+    FILE *file;
+
+    file = fopen(path, "w");
+    if (file == NULL)
+    {
+        perror(path);
+        return;
+    }
+
+    classes = malloc(sizeof(latency_class_t) * (process_count + 1));
+    assert(classes != NULL);
+    class_count = compute_latency_classes(classes);
+
+    fprintf(file, "{\n  \"context_switches\": %u,\n", context_switches);
+    fprintf(file, "  \"execution_time\": %.1f,\n", simulator_time / 10.0);
+    fprintf(file, "  \"ready_time\": %.1f,\n", ready_counter / 10.0);
+    if (switch_cost > 0 || cache_penalty > 0)
+        fprintf(file, "  \"lost_switch_time\": %.1f,\n"
+                "  \"lost_cache_time\": %.1f,\n"
+                "  \"cold_dispatches\": %u,\n",
+                lost_switch_ticks / 10.0, lost_cache_ticks / 10.0,
+                cold_dispatches);
+    if (periodic_count > 0)
+    {
+        unsigned int missed = 0;
+
+        for (n=0; n<process_count; n++)
+            missed += jobs_missed[n];
+        fprintf(file, "  \"jobs\": %u,\n  \"deadline_misses\": %u,\n",
+                job_count, missed);
+    }
+    if (cpu_cores_configured)
+    {
+        double energy = 0.0;
+
+        for (n=0; n<cpu_count; n++)
+            energy += cpu_cores[n].energy;
+        fprintf(file, "  \"energy\": %.3f,\n", energy / 1000.0);
+    }
+
+    fprintf(file, "  \"classes\": [\n");
+    for (c=0; c<class_count; c++)
+    {
+        name[0] = classes[c].name;
+        fprintf(file, "    {\"class\": ");
+        print_json_string(file, name[0] != '\0' ? name : "all");
+        fprintf(file, ", \"count\": %u, ", classes[c].count);
+        print_json_percentiles(file, "response", classes[c].response);
+        fprintf(file, ", ");
+        print_json_percentiles(file, "turnaround", classes[c].turnaround);
+        fprintf(file, ", ");
+        print_json_percentiles(file, "waiting", classes[c].waiting);
+        fprintf(file, "}%s\n", c + 1 < class_count ? "," : "");
+    }
+    fprintf(file, "  ],\n");
+
+    fprintf(file, "  \"processes\": [\n");
+    for (n=0; n<process_count; n++)
+    {
+        ps = &process_stats[n];
+        fprintf(file, "    {\"pid\": %u, \"name\": ", processes[n].pid);
+        print_json_string(file, processes[n].name);
+        fprintf(file, ", \"arrival\": %.1f, \"first_run\": %.1f,"
+                " \"completion\": %.1f, \"ready\": %.1f, \"running\": %.1f,"
+                " \"waiting\": %.1f, \"preemptions\": %u}%s\n",
+                processes[n].arrival / 10.0, ps->first_run / 10.0,
+                ps->completion / 10.0, ps->ready / 10.0, ps->running / 10.0,
+                ps->waiting / 10.0, ps->preemptions,
+                n + 1 < process_count ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+
+    free(classes);
+    fclose(file);
+}
+
+
+
+/*
+ * context_switch() and force_preempt() are the two functions available to
+ * student's code.
+ */
+extern void context_switch(unsigned int cpu_id, pcb_t *pcb,
+                           int preemption_time)
+{
+    assert(cpu_id < cpu_count);
+    assert(pcb == NULL || (pcb >= processes && pcb <= processes +
+        process_count - 1));
+
+    context_switches++;
+
+    IRWL_WRITER_UNLOCK(student_lock);
+    lock_simulator();
+    if (record_file != NULL)
+        record_decision(pcb ? DECISION_SWITCH : DECISION_IDLE, cpu_id, pcb,
+                        preemption_time);
+    switch_process(cpu_id, pcb, preemption_time);
+    unlock_simulator();
+    IRWL_WRITER_LOCK(student_lock);
+}
+
+/*
+ * switch_process() makes pcb the current process of a CPU, for
+ * context_switch() and the replay.  Must be called with the
+ * simulator_mutex held.
+ */
+static void switch_process(unsigned int cpu_id, pcb_t *pcb,
+                           int preemption_time)
+{
+    if (pcb != NULL && process_stats[pcb->pid].first_run == NOT_STARTED)
+        process_stats[pcb->pid].first_run = simulator_time;
+    /* The handler that switched also changed the state of the old one */
+    note_state_change(simulator_cpu_data[cpu_id].current);
+    note_state_change(pcb);
+    charge_switch_cost(cpu_id, pcb);
+    /* Partial ticks of work belong to the burst of the process */
+    if (pcb != simulator_cpu_data[cpu_id].current)
+        cpu_cores[cpu_id].credit = 0;
+    simulator_cpu_data[cpu_id].current = pcb;
+    simulator_cpu_data[cpu_id].preemption_timer = preemption_time;
+    __atomic_store_n(&simulator_cpu_data[cpu_id].ticks_run, 0,
+                     __ATOMIC_RELAXED);
+
+    /* Without CPU threads, nobody else updates the CPU state */
+    if (virtual_time)
+        simulator_cpu_data[cpu_id].state = pcb ? CPU_RUNNING : CPU_IDLE;
+}
+
+/*
+ * charge_switch_cost() sets the stall of a CPU that is about to run pcb.
+ * Must be called with the simulator_mutex held, before the CPU's current
+ * process is replaced.
+ */
+static void charge_switch_cost(unsigned int cpu_id, pcb_t *pcb)
+{
+    simulator_cpu_data_t *cpu = &simulator_cpu_data[cpu_id];
+
+    /* Idling, or resuming the process that was just preempted, is free */
+    cpu->switch_stall = cpu->cache_stall = 0;
+    if (pcb == NULL || pcb == cpu->current)
+        return;
+
+    costed_dispatches++;
+    cpu->switch_stall = switch_cost;
+    if (resident_cpu[pcb->pid] != (int)cpu_id ||
+        cpu->dispatches - resident_dispatch[pcb->pid] >= cache_depth)
+    {
+        cold_dispatches++;
+        cpu->cache_stall = cache_penalty;
+    }
+
+    /* Count the others dispatched here since, to age its cache */
+    cpu->dispatches++;
+    resident_cpu[pcb->pid] = (int)cpu_id;
+    resident_dispatch[pcb->pid] = cpu->dispatches;
+}
+
+/*
+ * consume_stall() spends up to ticks ticks of a CPU's stall, switch
+ * overhead first, and returns the number spent.
+ */
+static unsigned int consume_stall(unsigned int cpu_id, unsigned int ticks)
+{
+    simulator_cpu_data_t *cpu = &simulator_cpu_data[cpu_id];
+    unsigned int s, c;
+
+    s = ticks < cpu->switch_stall ? ticks : cpu->switch_stall;
+    cpu->switch_stall -= s;
+    lost_switch_ticks += s;
+
+    c = ticks - s < cpu->cache_stall ? ticks - s : cpu->cache_stall;
+    cpu->cache_stall -= c;
+    lost_cache_ticks += c;
+
+    return s + c;
+}
+
+/*
+ * retire_work() advances the CPU burst pc on a CPU by ticks ticks at the
+ * speed of its current level.
+ */
+static void retire_work(unsigned int cpu_id, op_t *pc, unsigned int ticks)
+{
+    cpu_core_t *core = &cpu_cores[cpu_id];
+    unsigned int speed, work;
+
+    speed = core->levels[__atomic_load_n(&core->level, __ATOMIC_RELAXED)].speed;
+    core->credit += ticks * speed;
+    work = core->credit / NOMINAL_SPEED;
+    if (work > pc->time)
+        work = pc->time;
+    pc->time -= work;
+    core->credit -= work * NOMINAL_SPEED;
+    if (pc->time == 0)
+        core->credit = 0;
+}
+
+/*
+ * ticks_to_retire() returns the ticks a CPU needs at its current level to
+ * retire work ticks of CPU burst.
+ */
+static unsigned int ticks_to_retire(unsigned int cpu_id, unsigned int work)
+{
+    cpu_core_t *core = &cpu_cores[cpu_id];
+    unsigned int speed;
+
+    if (work == 0)
+        return 0;
+    speed = core->levels[__atomic_load_n(&core->level, __ATOMIC_RELAXED)].speed;
+    return (work * NOMINAL_SPEED - core->credit + speed - 1) / speed;
+}
+
+/* account_energy() charges a CPU with a process for ticks ticks */
+static void account_energy(unsigned int cpu_id, unsigned int ticks)
+{
+    cpu_core_t *core = &cpu_cores[cpu_id];
+
+    core->busy_ticks += ticks;
+    core->energy += core->levels[__atomic_load_n(&core->level,
+                                                 __ATOMIC_RELAXED)].energy *
+                    ticks;
+}
+
+extern void force_preempt(unsigned int cpu_id)
+{
+    assert(cpu_id < cpu_count);
+
+    IRWL_WRITER_UNLOCK(student_lock);
+    lock_simulator();
+
+    /*
+     * It is possible that the student's code calls force_preempt() at the
+     * same time the process was already going to yield or terminate.  We
+     * check for that case by only preempting if the CPU is set to CPU_RUNNING.
+     */
+    if (simulator_cpu_data[cpu_id].state == CPU_RUNNING)
+    {
+        if (record_file != NULL)
+            record_decision(DECISION_PREEMPT, cpu_id, NULL, 0);
+        raise_cpu_event(cpu_id, CPU_PREEMPT);
+    }
+
+    unlock_simulator();
+    IRWL_WRITER_LOCK(student_lock);
+}
+
+
+
+/*
+ * The functions below are used by the supervisor thread to simulate the OS.
+ *
+ * simulate_cpus() / simulate_process() simulate the processes on each CPU
+ *   and signal the appropriate CPU thread if an event occurs.
+ *
+ * submit_io_request() inserts a PCB into tail of the I/O queue.
+ *
+ * simulate_io() simulates the I/O request at the head of the I/O queue and
+ *   calls wake_up() upon completion.
+ *
+ * simulate_creat() simulates process creation by calling the student's
+ *   wake_up() for every process whose arrival time has come.
+ */
+
+static void simulate_cpus(void)
+{
+    unsigned int n;
+
+    for (n=0; n<cpu_count; n++)
+    {
+        if (simulator_cpu_data[n].current != NULL)
+        {
+            account_energy(n, 1);
+            simulate_process(n, simulator_cpu_data[n].current);
+        }
+    }
+}
+
+static void simulate_process(unsigned int cpu_id, pcb_t *pcb)
+{
+    /*
+     * The "program counter" is really just a pointer to the current position
+     * in the operations array
+     */
+    op_t *pc = (op_t*)pcb->pc;
+
+    /* A stalled CPU does no work for the process this tick */
+    if (consume_stall(cpu_id, 1) > 0)
+        return;
+
+    switch (pc->type)
+    {
+    case OP_CPU:
+        /* Scheduling a running process ... good ... */
+
+        /* Check to see if the CPU burst has completed */
+        if (pc->time > 0)
+        {
+            /* Simulate running the process */
+            retire_work(cpu_id, pc, 1);
+            pcb->time_remaining = pc->time + 1;
+            __atomic_add_fetch(&simulator_cpu_data[cpu_id].ticks_run, 1,
+                               __ATOMIC_RELAXED);
+            /* Simulate the preemption timer */
+            simulator_cpu_data[cpu_id].preemption_timer--;
+            if (simulator_cpu_data[cpu_id].preemption_timer == 0)
+            {
+                /* The timer has expired; preempt the running process */
+                raise_cpu_event(cpu_id, CPU_PREEMPT);
+                sync_decisions();
+            }
+        }
+        else
+        {
+            /* Move to the next operation */
+            pcb->pc=((op_t*)(pcb->pc))+1;
+            pc++;
+            pcb->time_remaining = pcb->pc->time + 1;
+            if (pcb->period > 0 && pc->type != OP_CPU)
+                complete_job(pcb);
+            switch (pc->type)
+            {
+            case OP_IO:
+                /* Put a request in the I/O FIFO queue, or wait for the
+                   next release of a periodic process */
+                if (pcb->period > 0)
+                    sleep_until_release(pcb);
+                else
+                    submit_io_request(pcb, pc->time);
+
+                /* Generate a yield() call on the appropriate CPU */
+                raise_cpu_event(cpu_id, CPU_YIELD);
+                sync_decisions();
+
+                break;
+
+            case OP_TERMINATE:
+                /* Generate a terminate() call on the appropriate CPU */
+                process_stats[pcb->pid].completion = simulator_time;
+                raise_cpu_event(cpu_id, CPU_TERMINATE);
+                sync_decisions();
+
+                break;
+
+            case OP_CPU:
+                break;
+            }
+        }
+        break;
+
+    case OP_IO:
+        /* Scheduling a process that's blocked on I/O */
+        printf("Scheduled a process that's blocked on I/0! PID: %d\n", pcb->pid);
+        break;
+
+    case OP_TERMINATE:
+        /* Scheduling a process that's terminated */
+        printf("Scheduled a terminated process! PID: %d\n", pcb->pid);
+        break;
+    }
+}
+
+static void submit_io_request(pcb_t *pcb, unsigned int execution_time)
+{
+    io_device_t *device = &io_devices[pcb->pid % io_device_count];
+    io_request *r;
+
+    /* Take a request from the pool */
+    r = io_free_list;
+    assert(r != NULL);
+    io_free_list = r->next;
+    r->pcb = pcb;
+    r->execution_time = execution_time;
+    r->submitted = simulator_time;
+    r->next = NULL;
+
+    /* Add request to the tail of the device's queue */
+    if (device->tail != NULL)
+    {
+        device->tail->next = r;
+        device->tail = r;
+    }
+    else
+    {
+        device->head = r;
+        device->tail = r;
+    }
+
+    /* An idle channel starts serving it on this tick */
+    start_io_requests(device);
+}
+
+/*
+ * start_io_requests() moves waiting requests onto the free channels of a
+ * device, in the order of its discipline.
+ */
+static void start_io_requests(io_device_t *device)
+{
+    io_request *r, *prev, *pick, *pick_prev;
+    unsigned int c;
+
+    for (c=0; c<device->channels && device->head != NULL; c++)
+    {
+        if (device->active[c] != NULL)
+            continue;
+
+        pick = device->head;
+        pick_prev = NULL;
+        if (device->discipline == IO_SHORTEST_FIRST)
+        {
+            for (prev=device->head, r=prev->next; r != NULL;
+                 prev=r, r=r->next)
+            {
+                if (r->execution_time < pick->execution_time)
+                {
+                    pick = r;
+                    pick_prev = prev;
+                }
+            }
+        }
+
+        if (pick_prev == NULL)
+            device->head = pick->next;
+        else
+            pick_prev->next = pick->next;
+        if (device->tail == pick)
+            device->tail = pick_prev;
+        pick->next = NULL;
+
+        device->active[c] = pick;
+        device->wait_ticks += simulator_time - pick->submitted;
+    }
+}
+
+static void simulate_io(void)
+{
+    io_device_t *device;
+    io_request *completed;
+    unsigned int d, c;
+    pcb_t *pcb;
+
+    for (d=0; d<io_device_count; d++)
+    {
+        device = &io_devices[d];
+        for (c=0; c<device->channels; c++)
+        {
+            completed = device->active[c];
+            if (completed == NULL)
+                continue;
+            device->busy_ticks++;
+            if (completed->execution_time-- > 0)
+                continue;
+
+            /* Move the programs "PC" to the next "instruction" */
+            completed->pcb->pc = ((op_t*)completed->pcb->pc) + 1;
+            completed->pcb->time_remaining = completed->pcb->pc->time + 1;
+
+            /*
+             * Remove the I/O request from the device before calling the
+             * student's code.  We must do this, because once we release the
+             * simulator_mutex, the I/O queues may have changed.  The next
+             * waiting request starts on the following tick.
+             */
+            pcb = completed->pcb;
+            device->active[c] = NULL;
+            device->completed++;
+            completed->next = io_free_list;
+            io_free_list = completed;
+            start_io_requests(device);
+
+            call_wake_up(pcb);
+        }
+    }
+}
+
+/*
+ * print_io_stats() reports, for each device, the requests served, the
+ * fraction of channel time it was busy and the mean wait before service.
+ */
+static void print_io_stats(void)
+{
+    static const char *names[] = { "fifo", "sstf", "parallel" };
+    io_device_t *device;
+    unsigned int d;
+
+    printf("\nDevice  Discipline  Channels  Requests  Utilization"
+           "  Mean wait (s)\n");
+    for (d=0; d<io_device_count; d++)
+    {
+        device = &io_devices[d];
+        printf("%-7u %-11s %-9u %-9u %-12.2f %.1f\n", d,
+               names[device->discipline], device->channels, device->completed,
+               simulator_time ? (double)device->busy_ticks /
+                                ((double)simulator_time * device->channels)
+                              : 0.0,
+               device->completed ? (double)device->wait_ticks /
+                                   device->completed / 10.0 : 0.0);
+    }
+}
+
+/*
+ * complete_job() accounts the job of a periodic process that just
+ * completed.
+ */
+static void complete_job(pcb_t *pcb)
+{
+    int lateness = (int)(simulator_time - pcb->deadline);
+
+    if (job_count == job_capacity)
+    {
+        job_capacity = job_capacity ? job_capacity * 2 : 64;
+        job_lateness = realloc(job_lateness, sizeof(int) * job_capacity);
+        assert(job_lateness != NULL);
+    }
+    job_lateness[job_count++] = lateness;
+
+    if (jobs_completed[pcb->pid] == 0 ||
+        lateness > job_max_lateness[pcb->pid])
+        job_max_lateness[pcb->pid] = lateness;
+    jobs_completed[pcb->pid]++;
+    if (lateness > 0)
+        jobs_missed[pcb->pid]++;
+}
+
+/*
+ * sleep_until_release() puts a periodic process on the sleeping list until
+ * its next job is released.  A job released while the previous one was
+ * still running wakes up on this tick.
+ */
+static void sleep_until_release(pcb_t *pcb)
+{
+    unsigned int pid = pcb->pid, *link;
+
+    release_time[pid] += pcb->period;
+    for (link=&first_sleeper; *link != NO_SLEEPER &&
+         release_time[*link] <= release_time[pid]; link=&next_sleeper[*link])
+        ;
+    next_sleeper[pid] = *link;
+    *link = pid;
+}
+
+/*
+ * simulate_releases() wakes the periodic processes whose next job has been
+ * released, setting the deadline of the job.
+ */
+static void simulate_releases(void)
+{
+    pcb_t *pcb;
+
+    while (first_sleeper != NO_SLEEPER &&
+           release_time[first_sleeper] <= simulator_time)
+    {
+        pcb = &processes[first_sleeper];
+        first_sleeper = next_sleeper[first_sleeper];
+
+        /* Move past the wait to the job's CPU burst */
+        pcb->pc = ((op_t*)pcb->pc) + 1;
+        pcb->time_remaining = pcb->pc->time + 1;
+        pcb->deadline = release_time[pcb->pid] + pcb->relative_deadline;
+
+        call_wake_up(pcb);
+    }
+}
+
+/*
+ * call_wake_up() calls the student's wake_up() handler for a process that
+ * became ready.  Must be called with the simulator_mutex held, which is
+ * released meanwhile.
+ */
+static void call_wake_up(pcb_t *pcb)
+{
+    if (replaying)
+    {
+        pcb->state = PROCESS_READY;
+        note_state_change(pcb);
+        sync_decisions();
+        return;
+    }
+
+    unlock_simulator();
+    IRWL_WRITER_LOCK(student_lock);
+    wake_up(pcb);
+    IRWL_WRITER_UNLOCK(student_lock);
+    if (virtual_time)
+        dispatch_idle_cpus();
+    lock_simulator();
+    note_state_change(pcb);
+    sync_decisions();
+}
+
+static void simulate_creat(void)
+{
+    /* The process table is sorted by arrival time */
+    while (processes_created < process_count &&
+           processes[processes_created].arrival <= simulator_time)
+    {
+        call_wake_up(&processes[processes_created]);
+        processes_created++;
+    }
+}
+
+
+
+/*
+ * raise_cpu_event() hands a preempt, yield or terminate event to a CPU and
+ * returns once the student's handler has picked the next process.  Must be
+ * called with the simulator_mutex held.
+ */
+static void raise_cpu_event(unsigned int cpu_id, simulator_cpu_state_t state)
+{
+    simulator_cpu_data[cpu_id].state = state;
+    if (state == CPU_PREEMPT)
+        process_stats[simulator_cpu_data[cpu_id].current->pid].preemptions++;
+
+    if (virtual_time)
+    {
+        run_cpu_handler(cpu_id);
+        return;
+    }
+
+    IF_LOCKSTAT(simulator_cpu_data[cpu_id].signalled = lockstat_now();)
+    pthread_cond_signal(&simulator_cpu_data[cpu_id].wakeup);
+
+    /* Ensure the scheduler gets run before the simulator */
+    wait_simulator(&simulator_cpu_data[cpu_id].wakeup);
+}
+
+
+
+/*
+ * The functions below implement virtual time.  There are no CPU threads:
+ * the event loop calls the student's handlers itself, and a tick is only
+ * simulated in full when some event falls on it.  The ticks in between
+ * are skipped in one step, since nothing but the counters can change.
+ *
+ * run_cpu_handler() does what a CPU thread does for its pending event.
+ *
+ * dispatch_idle_cpus() calls idle() on every idle CPU after something may
+ *   have been added to the ready queue.  idle() returns at once when the
+ *   ready queue is empty in virtual time.
+ *
+ * skip_ticks() advances the clock over ticks without events.
+ *
+ * schedule_events() recomputes the next event of every source after a tick.
+ */
+static void run_cpu_handler(unsigned int cpu_id)
+{
+    simulator_cpu_state_t state = simulator_cpu_data[cpu_id].state;
+
+    if (state == CPU_TERMINATE)
+        processes_terminated++;
+    if (replaying)
+    {
+        replay_cpu_event(cpu_id, state);
+        return;
+    }
+    unlock_simulator();
+
+    IRWL_WRITER_LOCK(student_lock)
+    switch (state)
+    {
+    case CPU_PREEMPT:
+        preempt(cpu_id);
+        break;
+
+    case CPU_YIELD:
+        yield(cpu_id);
+        break;
+
+    case CPU_TERMINATE:
+        terminate(cpu_id);
+        break;
+
+    default:
+        break;
+    }
+    IRWL_WRITER_UNLOCK(student_lock)
+
+    dispatch_idle_cpus();
+    lock_simulator();
+}
+
+static void dispatch_idle_cpus(void)
+{
+    unsigned int n;
+
+    for (n=0; n<cpu_count; n++)
+    {
+        if (simulator_cpu_data[n].current == NULL)
+            idle(n);
+    }
+}
+
+static void simulator_event_loop(void)
+{
+    print_gantt_header();
+    lock_simulator();
+
+    while (1)
+    {
+        /* Exit when all processes terminate */
+        if (processes_terminated >= process_count)
+        {
+            print_final_stats();
+            exit(0);
+        }
+
+        skip_ticks(next_event_time() - simulator_time);
+
+        sync_decisions();
+        print_gantt_line();
+        simulate_cpus();
+        simulate_io();
+        simulate_releases();
+        simulate_creat();
+        simulator_time++;
+        sync_step = 0;
+
+        schedule_events();
+    }
+}
+
+static void skip_ticks(unsigned int ticks)
+{
+    unsigned int current_ready, current_running, current_waiting;
+    unsigned int n, run;
+    unsigned int d, c;
+    op_t *pc;
+
+    if (ticks == 0)
+        return;
+
+    /* Every skipped tick has the same Gantt line */
+    count_process_states(&current_running, &current_ready, &current_waiting);
+    if (gantt_chart)
+        for (n=0; n<ticks; n++)
+        {
+            print_gantt_row(current_running, current_ready, current_waiting);
+            simulator_time++;
+        }
+    else
+        simulator_time += ticks;
+
+    /* No event means no burst ends and no timer expires in between */
+    for (n=0; n<cpu_count; n++)
+    {
+        if (simulator_cpu_data[n].current == NULL)
+            continue;
+        account_energy(n, ticks);
+        run = ticks - consume_stall(n, ticks);
+        pc = simulator_cpu_data[n].current->pc;
+        retire_work(n, pc, run);
+        simulator_cpu_data[n].current->time_remaining = pc->time + 1;
+        simulator_cpu_data[n].ticks_run += run;
+        simulator_cpu_data[n].preemption_timer -= (int)run;
+    }
+
+    for (d=0; d<io_device_count; d++)
+    {
+        for (c=0; c<io_devices[d].channels; c++)
+        {
+            if (io_devices[d].active[c] == NULL)
+                continue;
+            io_devices[d].active[c]->execution_time -= ticks;
+            io_devices[d].busy_ticks += ticks;
+        }
+    }
+}
+
+static void schedule_events(void)
+{
+    unsigned int n, c, time, remaining, stall;
+    int timer;
+    op_t *pc;
+
+    for (n=0; n<cpu_count; n++)
+    {
+        time = NO_EVENT;
+        if (simulator_cpu_data[n].current != NULL)
+        {
+            /*
+             * A burst that takes r ticks at the CPU's speed completes on
+             * the (r+1)th tick, and the
+             * timer fires on the tick where it is decremented to zero.
+             * Both are pushed back by the ticks the CPU is still stalled.
+             */
+            pc = simulator_cpu_data[n].current->pc;
+            remaining = pc->type == OP_CPU ? ticks_to_retire(n, pc->time) : 0;
+            timer = simulator_cpu_data[n].preemption_timer;
+            stall = simulator_cpu_data[n].switch_stall +
+                    simulator_cpu_data[n].cache_stall;
+            time = simulator_time + stall + remaining;
+            if (timer >= 1 && (unsigned int)timer <= remaining)
+                time = simulator_time + stall + (unsigned int)timer - 1;
+        }
+        if (time != cpu_event_time[n])
+        {
+            cpu_event_time[n] = time;
+            push_event(EVENT_CPU, n, time);
+        }
+    }
+
+    /* One event for the I/O request that completes first */
+    time = NO_EVENT;
+    for (n=0; n<io_device_count; n++)
+    {
+        for (c=0; c<io_devices[n].channels; c++)
+        {
+            if (io_devices[n].active[c] != NULL &&
+                simulator_time + io_devices[n].active[c]->execution_time < time)
+                time = simulator_time + io_devices[n].active[c]->execution_time;
+        }
+    }
+    if (time != io_event_time)
+    {
+        io_event_time = time;
+        push_event(EVENT_IO, 0, time);
+    }
+
+    time = NO_EVENT;
+    if (first_sleeper != NO_SLEEPER)
+    {
+        time = release_time[first_sleeper];
+        if (time < simulator_time)
+            time = simulator_time;
+    }
+    if (time != release_event_time)
+    {
+        release_event_time = time;
+        push_event(EVENT_RELEASE, 0, time);
+    }
+
+    time = NO_EVENT;
+    if (processes_created < process_count)
+    {
+        time = processes[processes_created].arrival;
+        if (time < simulator_time)
+            time = simulator_time;
+    }
+    if (time != arrival_event_time)
+    {
+        arrival_event_time = time;
+        push_event(EVENT_ARRIVAL, 0, time);
+    }
+
+    time = NO_EVENT;
+    if (replay_next < replay_count)
+    {
+        time = replay_log[replay_next].time;
+        if (time < simulator_time)
+            time = simulator_time;
+    }
+    if (time != replay_event_time)
+    {
+        replay_event_time = time;
+        push_event(EVENT_REPLAY, 0, time);
+    }
+}
+
+static void push_event(simulator_event_type_t type, unsigned int id,
+                       unsigned int time)
 {
-    if (io_queue_head == NULL)
-        return; /* There are no I/O requests */
+    simulator_event_t event;
+    unsigned int n, parent;
+
+    if (time == NO_EVENT)
+        return;
+
+    if (event_count == event_capacity)
+    {
+        event_capacity = event_capacity ? event_capacity * 2 : 64;
+        event_heap = realloc(event_heap,
+                             sizeof(simulator_event_t) * event_capacity);
+        assert(event_heap != NULL);
+    }
+
+    event.time = time;
+    event.type = type;
+    event.id = id;
 
-    if (io_queue_head->execution_time-- <= 0)
+    /* Sift up */
+    for (n = event_count++; n > 0; n = parent)
     {
-        io_request *completed = io_queue_head;
-        pcb_t *pcb;
+        parent = (n - 1) / 2;
+        if (event_heap[parent].time <= time)
+            break;
+        event_heap[n] = event_heap[parent];
+    }
+    event_heap[n] = event;
+}
 
-        /* Move the programs "PC" to the next "instruction" */
-        completed->pcb->pc = ((op_t*)completed->pcb->pc) + 1;
-        completed->pcb->time_remaining = completed->pcb->pc->time + 1;
+/*
+ * next_event_time() returns the tick of the earliest pending event, or the
+ * current tick if there is none (all processes have terminated).
+ */
+static unsigned int next_event_time(void)
+{
+    simulator_event_t last;
+    unsigned int n, child, pending;
 
-        /*
-         * Remove the I/O request from the queue before calling the student's
-         * code.  We must do this, because once we release the simulator_mutex,
-         * the I/O queue may have changed.
-         */
-        pcb = completed->pcb;
-        io_queue_head = completed->next;
-        if (io_queue_head == NULL)
-            io_queue_tail = NULL;
-        free(completed);
+    while (event_count > 0)
+    {
+        switch (event_heap[0].type)
+        {
+        case EVENT_CPU:
+            pending = cpu_event_time[event_heap[0].id];
+            break;
+        case EVENT_IO:
+            pending = io_event_time;
+            break;
+        case EVENT_RELEASE:
+            pending = release_event_time;
+            break;
+        case EVENT_REPLAY:
+            pending = replay_event_time;
+            break;
+        default:
+            pending = arrival_event_time;
+            break;
+        }
+        if (event_heap[0].time == pending && pending >= simulator_time)
+            return pending;
 
-        /* Call the student's wake_up() handler */
-        pthread_mutex_unlock(&simulator_mutex);
-        IRWL_WRITER_LOCK(student_lock);
-        wake_up(pcb);
-        IRWL_WRITER_UNLOCK(student_lock);
-        pthread_mutex_lock(&simulator_mutex);
+        /* Stale event: pop it and sift down */
+        last = event_heap[--event_count];
+        for (n = 0; (child = 2 * n + 1) < event_count; n = child)
+        {
+            if (child + 1 < event_count &&
+                event_heap[child + 1].time < event_heap[child].time)
+                child++;
+            if (last.time <= event_heap[child].time)
+                break;
+            event_heap[n] = event_heap[child];
+        }
+        event_heap[n] = last;
     }
+
+    return simulator_time;
 }
 
-static void simulate_creat(void)
+
+/*
+ * The functions below record and replay the scheduler's decisions.
+ *
+ * sync_decisions() ends a window in which the scheduler may have run.
+ *   When replaying, it first makes the decisions recorded in the window.
+ *
+ * apply_decision() makes one recorded decision, and fails if it cannot
+ *   have been made at this point of the run.
+ *
+ * replay_cpu_event() changes the state of the process on a CPU the way the
+ *   scheduler's preempt(), yield() or terminate() handler does.
+ *
+ * All of them must be called with the simulator_mutex held.
+ */
+static void sync_decisions(void)
 {
-    static int processes_created = 0;
+    const decision_t *d;
+    unsigned int n;
+
+    while (replaying && replay_next < replay_count)
+    {
+        d = &replay_log[replay_next];
+        if (d->time > simulator_time ||
+            (d->time == simulator_time && d->step > sync_step))
+            break;
+        if (d->time < simulator_time || d->step < sync_step)
+            replay_diverged("its window has passed", d);
+        if (apply_decision(d) != 0)
+            replay_diverged("it cannot be made", d);
+        replay_next++;
+    }
 
-    if ((simulator_time % 10) == 0 && processes_created < PROCESS_COUNT)
+    /* Every handler ends with a decision for its CPU */
+    for (n=0; replaying && n<cpu_count; n++)
     {
-        /* Call student's wake_up() handler */
-        pthread_mutex_unlock(&simulator_mutex);
-        IRWL_WRITER_LOCK(student_lock);
-        wake_up(&processes[processes_created]);
-        IRWL_WRITER_UNLOCK(student_lock);
-        pthread_mutex_lock(&simulator_mutex);
+        if (simulator_cpu_data[n].state != CPU_RUNNING &&
+            simulator_cpu_data[n].state != CPU_IDLE)
+            replay_diverged("a CPU has no decision after its event", NULL);
+    }
 
-        processes_created++;
+    sync_step++;
+}
+
+static int apply_decision(const decision_t *d)
+{
+    pcb_t *pcb;
+
+    if (d->cpu >= cpu_count)
+        return -1;
+    if (record_file != NULL)
+        print_decision(record_file, d);
+
+    switch (d->type)
+    {
+    case DECISION_SWITCH:
+        if (d->pid >= process_count ||
+            d->level >= cpu_cores[d->cpu].level_count)
+            return -1;
+        pcb = &processes[d->pid];
+        if (pcb->state != PROCESS_READY)
+            return -1;
+        pcb->state = PROCESS_RUNNING;
+        cpu_cores[d->cpu].level = d->level;
+        switch_process(d->cpu, pcb, d->time_slice);
+        context_switches++;
+        break;
+
+    case DECISION_IDLE:
+        switch_process(d->cpu, NULL, d->time_slice);
+        context_switches++;
+        break;
+
+    case DECISION_PREEMPT:
+        if (simulator_cpu_data[d->cpu].state != CPU_RUNNING)
+            return -1;
+        raise_cpu_event(d->cpu, CPU_PREEMPT);
+        break;
+    }
+    return 0;
+}
+
+static void replay_cpu_event(unsigned int cpu_id, simulator_cpu_state_t state)
+{
+    pcb_t *pcb = simulator_cpu_data[cpu_id].current;
+
+    switch (state)
+    {
+    case CPU_PREEMPT:
+        pcb->state = PROCESS_READY;
+        break;
+
+    case CPU_YIELD:
+        pcb->state = PROCESS_WAITING;
+        break;
+
+    case CPU_TERMINATE:
+        pcb->state = PROCESS_TERMINATED;
+        break;
+
+    default:
+        break;
+    }
+}
+
+/* replay_diverged() stops a replay that no longer follows its recording */
+static void replay_diverged(const char *reason, const decision_t *d)
+{
+    fprintf(stderr, "Replay diverged from the recording at %.1f s, step %u:"
+            " %s\n", (float)simulator_time / 10.0, sync_step, reason);
+    if (d != NULL)
+    {
+        fprintf(stderr, "  decision %u: ", replay_next + 1);
+        print_decision(stderr, d);
+    }
+    exit(-1);
+}
+
+/*
+ * record_decision() logs a decision being made now.  Must be called with
+ * the simulator_mutex held.
+ */
+static void record_decision(decision_type_t type, unsigned int cpu_id,
+                            const pcb_t *pcb, int time_slice)
+{
+    decision_t d;
+
+    d.time = simulator_time;
+    d.step = sync_step;
+    d.type = type;
+    d.cpu = cpu_id;
+    d.pid = pcb != NULL ? pcb->pid : 0;
+    d.time_slice = time_slice;
+    d.level = __atomic_load_n(&cpu_cores[cpu_id].level, __ATOMIC_RELAXED);
+    print_decision(record_file, &d);
+}
+
+/* print_decision() prints a decision as a line of a recording */
+static void print_decision(FILE *file, const decision_t *d)
+{
+    switch (d->type)
+    {
+    case DECISION_SWITCH:
+        fprintf(file, "%u %u switch %u %u %d %u\n", d->time, d->step, d->cpu,
+                d->pid, d->time_slice, d->level);
+        break;
+
+    case DECISION_IDLE:
+        fprintf(file, "%u %u idle %u\n", d->time, d->step, d->cpu);
+        break;
+
+    case DECISION_PREEMPT:
+        fprintf(file, "%u %u preempt %u\n", d->time, d->step, d->cpu);
+        break;
     }
 }
 
+/*
+ * load_recording() reads the decisions of a recording, and the CPUs and
+ * processes of the recorded run from its header.  Returns 0, or -1 with
+ * an error printed.
+ */
+static int load_recording(const char *path, decision_t **log,
+                          unsigned int *count, unsigned int *cpus,
+                          unsigned int *processes_recorded)
+{
+    unsigned int capacity = 0, line_number = 0;
+    char line[128], type[16];
+    int fields, malformed = 0;
+    decision_t d;
+    FILE *file;
+
+    file = fopen(path, "r");
+    if (file == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+
+    *log = NULL;
+    *count = *cpus = *processes_recorded = 0;
+    while (!malformed && fgets(line, sizeof(line), file) != NULL)
+    {
+        line_number++;
+        if (line[0] == '#')
+        {
+            sscanf(line, "# os-sim recording: %u CPUs, %u processes", cpus,
+                   processes_recorded);
+            continue;
+        }
+
+        memset(&d, 0, sizeof(d));
+        fields = sscanf(line, "%u %u %15s %u %u %d %u", &d.time, &d.step,
+                        type, &d.cpu, &d.pid, &d.time_slice, &d.level);
+        if (fields == 7 && strcmp(type, "switch") == 0)
+            d.type = DECISION_SWITCH;
+        else if (fields == 4 && strcmp(type, "idle") == 0)
+            d.type = DECISION_IDLE;
+        else if (fields == 4 && strcmp(type, "preempt") == 0)
+            d.type = DECISION_PREEMPT;
+        else
+        {
+            fprintf(stderr, "%s:%u: malformed decision\n", path, line_number);
+            malformed = 1;
+            continue;
+        }
+
+        if (*count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 1024;
+            *log = realloc(*log, sizeof(decision_t) * capacity);
+            assert(*log != NULL);
+        }
+        (*log)[(*count)++] = d;
+    }
+    fclose(file);
+
+    if (!malformed && *cpus == 0)
+    {
+        fprintf(stderr, "%s: not an os-sim recording\n", path);
+        malformed = 1;
+    }
+    if (malformed)
+    {
+        free(*log);
+        *log = NULL;
+        return -1;
+    }
+    return 0;
+}
 
 
 /* Cheap hack -- passing an int through a void pointer */
@@ -622,6 +2337,321 @@ static void *simulator_cpu_thread_func(void *data)
 }
 
 
+/*
+ * simulator_enable_virtual_time() and simulator_virtual_time() select and
+ * query the discrete-event mode (--fast).
+ */
+extern void simulator_enable_virtual_time(void)
+{
+    virtual_time = 1;
+}
+
+extern int simulator_virtual_time(void)
+{
+    return virtual_time;
+}
+
+
+/*
+ * simulator_set_io_devices() parses a comma-separated list of devices:
+ * fifo, sstf or parallel:<channels>.
+ */
+extern int simulator_set_io_devices(const char *spec)
+{
+    unsigned int count = 1, d, channels;
+    io_discipline_t discipline;
+    const char *p;
+    char *end;
+
+    for (p=spec; *p != '\0'; p++)
+        if (*p == ',')
+            count++;
+
+    free(io_devices);
+    io_devices = calloc(count, sizeof(io_device_t));
+    assert(io_devices != NULL);
+    io_device_count = count;
+
+    p = spec;
+    for (d=0; d<count; d++)
+    {
+        channels = 1;
+        if (strncmp(p, "fifo", 4) == 0)
+        {
+            discipline = IO_FIFO;
+            p += 4;
+        }
+        else if (strncmp(p, "sstf", 4) == 0)
+        {
+            discipline = IO_SHORTEST_FIRST;
+            p += 4;
+        }
+        else if (strncmp(p, "parallel:", 9) == 0)
+        {
+            discipline = IO_PARALLEL;
+            channels = (unsigned int)strtoul(p + 9, &end, 10);
+            if (end == p + 9 || channels < 1)
+                break;
+            p = end;
+        }
+        else
+            break;
+        if (*p != (d + 1 < count ? ',' : '\0'))
+            break;
+        p++;
+
+        io_devices[d].discipline = discipline;
+        io_devices[d].channels = channels;
+        io_devices[d].active = calloc(channels, sizeof(io_request*));
+        assert(io_devices[d].active != NULL);
+    }
+
+    if (d < count)
+    {
+        fprintf(stderr, "Bad I/O device list \"%s\": expected fifo, sstf or"
+                " parallel:<channels>, separated by commas\n", spec);
+        return -1;
+    }
+    io_devices_configured = 1;
+    return 0;
+}
+
+/*
+ * simulator_set_switch_cost() and simulator_set_cache_penalty() configure
+ * the context switch cost model.
+ */
+extern void simulator_set_switch_cost(unsigned int ticks)
+{
+    switch_cost = ticks;
+}
+
+extern void simulator_set_cache_penalty(unsigned int ticks,
+                                        unsigned int depth)
+{
+    cache_penalty = ticks;
+    cache_depth = depth;
+}
+
+/*
+ * simulator_set_cores() parses a comma-separated list of CPUs, each an
+ * optional <n>x repeat count and a slash-separated list of DVFS levels
+ * <speed>:<energy>.
+ */
+extern int simulator_set_cores(const char *spec)
+{
+    unsigned int repeat, levels, n, l;
+    cpu_level_t *level;
+    const char *p = spec, *q;
+    char *end;
+
+    free(cpu_cores);
+    cpu_cores = NULL;
+    cpu_core_count = 0;
+
+    while (1)
+    {
+        repeat = 1;
+        q = strpbrk(p, "x:,");
+        if (q != NULL && *q == 'x')
+        {
+            repeat = (unsigned int)strtoul(p, &end, 10);
+            if (end != q || repeat < 1)
+                break;
+            p = q + 1;
+        }
+
+        /* q ends the CPU, at the next comma or the end of spec */
+        levels = 1;
+        for (q=p; *q != '\0' && *q != ','; q++)
+            if (*q == '/')
+                levels++;
+        level = malloc(sizeof(cpu_level_t) * levels);
+        assert(level != NULL);
+        for (l=0; l<levels; l++)
+        {
+            level[l].speed = (unsigned int)strtoul(p, &end, 10);
+            if (end == p || level[l].speed < 1 || *end != ':')
+                break;
+            p = end + 1;
+            level[l].energy = strtod(p, &end);
+            if (end == p || level[l].energy < 0.0)
+                break;
+            p = end;
+            if (l + 1 < levels ? *p != '/' : p != q)
+                break;
+            if (*p == '/')
+                p++;
+        }
+        if (l < levels)
+        {
+            free(level);
+            break;
+        }
+
+        cpu_cores = realloc(cpu_cores,
+                            sizeof(cpu_core_t) * (cpu_core_count + repeat));
+        assert(cpu_cores != NULL);
+        for (n=0; n<repeat; n++)
+        {
+            memset(&cpu_cores[cpu_core_count], 0, sizeof(cpu_core_t));
+            cpu_cores[cpu_core_count].levels = level;
+            cpu_cores[cpu_core_count].level_count = levels;
+            cpu_core_count++;
+        }
+
+        if (*p == '\0')
+        {
+            cpu_cores_configured = 1;
+            return 0;
+        }
+        p++;
+    }
+
+    fprintf(stderr, "Bad core list \"%s\": expected [<n>x]<speed>:<energy>"
+            "[/<speed>:<energy>]..., separated by commas\n", spec);
+    return -1;
+}
+
+/*
+ * simulator_cpu_levels(), simulator_cpu_speed() and simulator_set_cpu_level()
+ * query and change the DVFS level of a CPU.
+ */
+extern unsigned int simulator_cpu_levels(unsigned int cpu_id)
+{
+    assert(cpu_id < cpu_count);
+    return cpu_cores[cpu_id].level_count;
+}
+
+extern unsigned int simulator_cpu_speed(unsigned int cpu_id,
+                                        unsigned int level)
+{
+    assert(cpu_id < cpu_count && level < cpu_cores[cpu_id].level_count);
+    return cpu_cores[cpu_id].levels[level].speed;
+}
+
+extern void simulator_set_cpu_level(unsigned int cpu_id, unsigned int level)
+{
+    assert(cpu_id < cpu_count && level < cpu_cores[cpu_id].level_count);
+    __atomic_store_n(&cpu_cores[cpu_id].level, level, __ATOMIC_RELAXED);
+}
+
+/*
+ * simulator_record() and simulator_replay() select recording or replaying
+ * of the scheduler's decisions.
+ */
+extern int simulator_record(const char *path)
+{
+    record_file = fopen(path, "w");
+    if (record_file == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+extern int simulator_replay(const char *path)
+{
+    if (load_recording(path, &replay_log, &replay_count, &replay_cpu_count,
+                       &replay_process_count) != 0)
+        return -1;
+    replaying = 1;
+    virtual_time = 1;
+    return 0;
+}
+
+/*
+ * simulator_compare_recordings() reports the first decision where two
+ * recordings differ.
+ */
+extern int simulator_compare_recordings(const char *a, const char *b)
+{
+    decision_t *log_a, *log_b, *da, *db;
+    unsigned int count_a, count_b, cpus_a, cpus_b, processes_a, processes_b;
+    unsigned int n;
+    int result = 1;
+
+    if (load_recording(a, &log_a, &count_a, &cpus_a, &processes_a) != 0)
+        return -1;
+    if (load_recording(b, &log_b, &count_b, &cpus_b, &processes_b) != 0)
+    {
+        free(log_a);
+        return -1;
+    }
+
+    for (n=0; n<count_a && n<count_b; n++)
+    {
+        da = &log_a[n];
+        db = &log_b[n];
+        if (da->time != db->time || da->step != db->step ||
+            da->type != db->type || da->cpu != db->cpu ||
+            da->pid != db->pid || da->time_slice != db->time_slice ||
+            da->level != db->level)
+            break;
+    }
+
+    if (cpus_a != cpus_b || processes_a != processes_b)
+        printf("The recordings are of different runs: %u CPUs and %u"
+               " processes, and %u CPUs and %u processes\n", cpus_a,
+               processes_a, cpus_b, processes_b);
+    else if (n == count_a && n == count_b)
+    {
+        printf("The recordings are identical, %u decisions\n", count_a);
+        result = 0;
+    }
+    else
+    {
+        printf("The recordings diverge at decision %u, %.1f s:\n", n + 1,
+               (float)(n < count_a && (n == count_b ||
+                                       log_a[n].time < log_b[n].time) ?
+                       log_a[n].time : log_b[n].time) / 10.0);
+        printf("  %s: ", a);
+        if (n < count_a)
+            print_decision(stdout, &log_a[n]);
+        else
+            printf("(end of recording)\n");
+        printf("  %s: ", b);
+        if (n < count_b)
+            print_decision(stdout, &log_b[n]);
+        else
+            printf("(end of recording)\n");
+    }
+
+    free(log_a);
+    free(log_b);
+    return result;
+}
+
+extern void simulator_enable_latency_report(void)
+{
+    latency_report = 1;
+}
+
+/* simulator_enable_json_report() writes a JSON report at the end */
+extern void simulator_enable_json_report(const char *path)
+{
+    json_report_path = path;
+}
+
+extern void simulator_disable_gantt_chart(void)
+{
+    gantt_chart = 0;
+}
+
+/* simulator_current_time() returns the current tick */
+extern unsigned int simulator_current_time(void)
+{
+    return __atomic_load_n(&simulator_time, __ATOMIC_RELAXED);
+}
+
+extern unsigned int simulator_ticks_run(unsigned int cpu_id)
+{
+    assert(cpu_id < cpu_count);
+    return __atomic_load_n(&simulator_cpu_data[cpu_id].ticks_run,
+                           __ATOMIC_RELAXED);
+}
+
+
 /* mt_safe_usleep() emulates the usleep() function, but is thread-safe */
 extern void mt_safe_usleep(long usec)
 {
@@ -43,6 +43,25 @@ typedef enum {
  *
  *   next : An unused pointer to another PCB.  You may use this pointer to
  *        build a linked-list of PCBs.
+ *
+ *   arrival : The tick at which the process is created. (read-only)
+ *
+ *   priority : The static priority of the process, a nice value where lower
+ *        numbers are more important.  Defaults to 0. (read-only)
+ *
+ *   period : For a periodic real-time process, the ticks between the
+ *        releases of its jobs, or 0. (read-only)
+ *
+ *   relative_deadline : The ticks a job of a periodic process has to
+ *        complete after its release. (read-only)
+ *
+ *   deadline : The tick by which the current job of a periodic process
+ *        must complete, updated by the simulator on every release.
+ *        (read-only)
+ *
+ *   tgid : The pid of the process a thread belongs to.  Each thread of a
+ *        multi-threaded process has its own PCB and pid, and its process's
+ *        first thread has pid == tgid.  (read-only)
  */
 typedef enum { OP_CPU = 0, OP_IO, OP_TERMINATE } op_type;
 
@@ -59,12 +78,19 @@ typedef struct _pcb_t {
     process_state_t state;
     op_t *pc;
     struct _pcb_t *next;
+    unsigned int arrival;
+    int priority;
+    unsigned int period;
+    unsigned int relative_deadline;
+    unsigned int deadline;
+    const unsigned int tgid;
 } pcb_t;
 
 
 /*
- * start_simulator() runs the OS simulation.  The number of CPUs (1-16) should
- * be passed as the parameter.
+ * start_simulator() runs the OS simulation.  The number of CPUs (1 or more)
+ * should be passed as the parameter.  The process table must have been
+ * built with create_processes() first.
  */
 extern void start_simulator(unsigned int cpu_count);
 
@@ -92,6 +118,131 @@ extern void context_switch(unsigned int cpu_id, pcb_t *pcb,
 extern void force_preempt(unsigned int cpu_id);
 
 
+/*
+ * simulator_enable_virtual_time() switches the simulator to virtual time
+ * (--fast) and must be called before start_simulator().  Instead of one
+ * thread per CPU advancing a tick at a time, a discrete-event loop jumps
+ * from one event to the next and calls the handlers itself.
+ *
+ * simulator_virtual_time() returns nonzero in virtual time.  idle() must
+ * then return instead of blocking when there is nothing to run; it is
+ * called again whenever a process may have become ready.
+ */
+extern void simulator_enable_virtual_time(void);
+extern int simulator_virtual_time(void);
+
+
+/*
+ * simulator_disable_gantt_chart() stops the simulator from printing a
+ * Gantt chart row per tick, so only the final statistics are printed.  In
+ * virtual time a run then costs only its events, not one row for every
+ * tick it skips.
+ */
+extern void simulator_disable_gantt_chart(void);
+
+
+/*
+ * simulator_current_time() returns the current simulated time in ticks
+ * (1/10th sec.).  Schedulers can use it to account how long a process ran.
+ *
+ * simulator_ticks_run() returns the ticks of its CPU burst that the process
+ * on a CPU has run since it was dispatched.  Unlike the time since the
+ * dispatch, it leaves out the ticks lost to switch overhead and cache
+ * refills, and it reaches the time slice exactly when the slice expires.
+ */
+extern unsigned int simulator_current_time(void);
+extern unsigned int simulator_ticks_run(unsigned int cpu_id);
+
+
+/*
+ * simulator_enable_latency_report() makes the simulator also print the
+ * response/turnaround/waiting time percentiles per process class and the
+ * mean turnaround time with the final statistics.  It must be called before
+ * start_simulator().
+ */
+extern void simulator_enable_latency_report(void);
+
+
+/*
+ * simulator_enable_json_report() makes the simulator write its final
+ * statistics, the response/turnaround/waiting time percentiles per process
+ * class and the accounting of every process to path as JSON.  It must be
+ * called before start_simulator().
+ */
+extern void simulator_enable_json_report(const char *path);
+
+
+/*
+ * simulator_set_io_devices() replaces the single FIFO I/O device with the
+ * devices listed in spec, separated by commas.  Each is "fifo", "sstf"
+ * (one channel, shortest request first) or "parallel:<n>" (n channels).
+ * Process n uses device n modulo the number of devices.  It must be called
+ * before start_simulator(), and returns 0 or -1 if spec is malformed.
+ */
+extern int simulator_set_io_devices(const char *spec);
+
+
+/*
+ * simulator_set_switch_cost() makes every dispatch of a process other than
+ * the one that was just running on the CPU stall the CPU for ticks ticks.
+ *
+ * simulator_set_cache_penalty() adds ticks more when the process's cache is
+ * cold: on its first dispatch, when it last ran on another CPU, or when
+ * depth other processes have been dispatched on the CPU since it ran there.
+ *
+ * A stalled CPU makes no progress on the burst or the time slice, and the
+ * lost CPU time is reported at the end.  Both must be called before
+ * start_simulator(), and depth must be at least 1.
+ */
+extern void simulator_set_switch_cost(unsigned int ticks);
+extern void simulator_set_cache_penalty(unsigned int ticks,
+                                        unsigned int depth);
+
+
+/*
+ * simulator_set_cores() describes the CPUs, which otherwise all run at the
+ * nominal speed.  spec lists one CPU per comma, or <n>x for n identical
+ * CPUs, each with its DVFS levels separated by slashes as <speed>:<energy>.
+ * speed is in percent of the nominal speed and energy in millijoules per
+ * tick with a process, e.g. "2x200:40/100:12,2x100:8/50:3" for two big and
+ * two little cores.  A CPU starts at its first level.  It must be called
+ * before start_simulator() and describe exactly cpu_count CPUs, and returns
+ * 0 or -1 if spec is malformed.  The energy used is reported at the end.
+ *
+ * simulator_cpu_levels() returns the number of levels of a CPU,
+ * simulator_cpu_speed() the speed of one of them, and
+ * simulator_set_cpu_level() switches the CPU to a level from then on.
+ */
+extern int simulator_set_cores(const char *spec);
+extern unsigned int simulator_cpu_levels(unsigned int cpu_id);
+extern unsigned int simulator_cpu_speed(unsigned int cpu_id,
+                                        unsigned int level);
+extern void simulator_set_cpu_level(unsigned int cpu_id, unsigned int level);
+
+
+/*
+ * simulator_record() logs every decision of the scheduler, each
+ * context_switch() and each force_preempt() that takes effect, to path
+ * with the simulated time it was made at.
+ *
+ * simulator_replay() makes the decisions of a recording instead of calling
+ * the scheduler, and reproduces the recorded run in virtual time.  The run
+ * must have the same CPUs, processes and simulator options as the recorded
+ * one.  A replay that cannot follow its recording stops with the point
+ * where it diverged.
+ *
+ * Both must be called before start_simulator(), and return 0 or -1 if path
+ * cannot be opened or read.
+ *
+ * simulator_compare_recordings() prints the first decision where two
+ * recordings differ.  It returns 0 if they are identical, 1 if they differ
+ * and -1 if either cannot be read.
+ */
+extern int simulator_record(const char *path);
+extern int simulator_replay(const char *path);
+extern int simulator_compare_recordings(const char *a, const char *b);
+
+
 /*
  * mt_safe_usleep() is a thread-safe implementation of the usleep() function.
  * See man usleep(3) for the behavior of this function.
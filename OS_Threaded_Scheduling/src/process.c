@@ -5,9 +5,13 @@
  * This file contains process data for the simulator.
  */
 
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "os-sim.h"
 #include "process.h"
-#include <stdlib.h>
 
 /*
  * Note: The operations must alternate: OP_CPU, OP_IO, OP_CPU, ...
@@ -223,15 +227,244 @@ static op_t pid7_ops[] = {
     { OP_TERMINATE, 0 }
 };
 
-pcb_t processes[PROCESS_COUNT] = {
-    { 0, "Iapache", 2, PROCESS_NEW, pid0_ops, NULL },
-    { 1, "Ibash", 3, PROCESS_NEW, pid1_ops, NULL },
-    { 2, "Imozilla", 1, PROCESS_NEW, pid2_ops, NULL },
-    { 3, "Ccpu", 9, PROCESS_NEW, pid3_ops, NULL },
-    { 4, "Cgcc", 10, PROCESS_NEW, pid4_ops, NULL },
-    { 5, "Cspice", 9, PROCESS_NEW, pid5_ops, NULL },
-    { 6, "Cmysql", 6, PROCESS_NEW, pid6_ops, NULL },
-    { 7, "Csim", 6, PROCESS_NEW, pid7_ops, NULL }
+static const struct {
+    const char *name;
+    const op_t *ops;
+    size_t op_count;
+} templates[DEFAULT_PROCESS_COUNT] = {
+    { "Iapache", pid0_ops, sizeof(pid0_ops) / sizeof(op_t) },
+    { "Ibash", pid1_ops, sizeof(pid1_ops) / sizeof(op_t) },
+    { "Imozilla", pid2_ops, sizeof(pid2_ops) / sizeof(op_t) },
+    { "Ccpu", pid3_ops, sizeof(pid3_ops) / sizeof(op_t) },
+    { "Cgcc", pid4_ops, sizeof(pid4_ops) / sizeof(op_t) },
+    { "Cspice", pid5_ops, sizeof(pid5_ops) / sizeof(op_t) },
+    { "Cmysql", pid6_ops, sizeof(pid6_ops) / sizeof(op_t) },
+    { "Csim", pid7_ops, sizeof(pid7_ops) / sizeof(op_t) }
 };
 
+pcb_t *processes;
+unsigned int process_count;
+
+/*
+ * create_processes() builds a table of count processes.  The simulator
+ * consumes the operations as it runs them, so every process gets its own
+ * copy.  Copies past the first DEFAULT_PROCESS_COUNT are named after their
+ * template with the copy number appended.
+ */
+extern void create_processes(unsigned int count)
+{
+    unsigned int n;
+
+    processes = malloc(sizeof(pcb_t) * count);
+    assert(processes != NULL);
+    process_count = count;
+
+    for (n=0; n<count; n++)
+    {
+        unsigned int t = n % DEFAULT_PROCESS_COUNT;
+        op_t *ops;
+        char *name;
+
+        ops = malloc(sizeof(op_t) * templates[t].op_count);
+        assert(ops != NULL);
+        memcpy(ops, templates[t].ops, sizeof(op_t) * templates[t].op_count);
+
+        name = malloc(strlen(templates[t].name) + 12);
+        assert(name != NULL);
+        if (n < DEFAULT_PROCESS_COUNT)
+            strcpy(name, templates[t].name);
+        else
+            sprintf(name, "%s%u", templates[t].name, n / DEFAULT_PROCESS_COUNT);
+
+        /* pid is const, so the PCB is initialized as a whole */
+        pcb_t pcb = { n, name, ops[0].time, PROCESS_NEW, ops, NULL,
+                      10 * n, 0, 0, 0, 0, n };
+        memcpy(&processes[n], &pcb, sizeof(pcb_t));
+    }
+}
+
+
+/* One parsed line of a workload file, before pids are assigned */
+typedef struct {
+    char *name;
+    unsigned int arrival;
+    int priority;
+    unsigned int period, deadline;
+    unsigned int thread;
+    op_t *ops;
+    unsigned int line;
+} workload_entry;
+
+static int compare_arrival(const void *a, const void *b)
+{
+    const workload_entry *x = a, *y = b;
+
+    if (x->arrival != y->arrival)
+        return x->arrival < y->arrival ? -1 : 1;
+    /* Keep the file order for processes arriving together */
+    return x->line < y->line ? -1 : x->line > y->line;
+}
+
+extern int load_processes(const char *path)
+{
+    FILE *file;
+    char *line = NULL, name[64];
+    size_t line_size = 0;
+    workload_entry *entries = NULL;
+    unsigned int count = 0, capacity = 0, line_no = 0, n, tgid = 0;
+
+    file = fopen(path, "r");
+    if (file == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+
+    /* Generated workloads can have lines of any length */
+    while (getline(&line, &line_size, file) != -1)
+    {
+        workload_entry entry;
+        unsigned int bursts = 0, burst_capacity = 16;
+        unsigned long value;
+        char *p, *end;
+        int offset;
+
+        line_no++;
+        p = line + strspn(line, " \t\r\n");
+        if (*p == '\0' || *p == '#')
+            continue;
+
+        if (*p == '+')
+        {
+            /* Another thread of the process on the previous line */
+            if (count == 0)
+            {
+                fprintf(stderr, "%s:%u: thread before any process\n",
+                        path, line_no);
+                free(line);
+            fclose(file);
+                return -1;
+            }
+            entry = entries[count - 1];
+            entry.thread++;
+            p++;
+        }
+        else if (sscanf(p, "%63s %u %d%n", name, &entry.arrival,
+                        &entry.priority, &offset) != 3)
+        {
+            fprintf(stderr, "%s:%u: expected <name> <arrival> <priority>\n",
+                    path, line_no);
+            free(line);
+            fclose(file);
+            return -1;
+        }
+        else
+        {
+            p += offset;
+            entry.thread = 0;
+        }
+
+        /* A periodic process has <period>:<deadline> and one burst per job */
+        if (entry.thread > 0)
+            ;
+        else if (sscanf(p, " %u:%u%n", &entry.period, &entry.deadline,
+                        &offset) != 2)
+            entry.period = entry.deadline = 0;
+        else
+        {
+            if (entry.period < 1 || entry.deadline < 1)
+            {
+                fprintf(stderr, "%s:%u: period and deadline must be"
+                        " positive\n", path, line_no);
+                free(line);
+            fclose(file);
+                return -1;
+            }
+            p += offset;
+        }
+
+        /* Parse the alternating CPU and I/O bursts */
+        entry.ops = malloc(sizeof(op_t) * burst_capacity);
+        assert(entry.ops != NULL);
+        while (1)
+        {
+            value = strtoul(p, &end, 10);
+            if (end == p)
+                break;
+            p = end;
+            /* Room for a release wait, the burst and OP_TERMINATE */
+            if (bursts + 3 > burst_capacity)
+            {
+                burst_capacity *= 2;
+                entry.ops = realloc(entry.ops, sizeof(op_t) * burst_capacity);
+                assert(entry.ops != NULL);
+            }
+            /* Jobs are separated by a wait for the next release, which
+             * the simulator runs in place of the I/O */
+            if (entry.period > 0 && bursts > 0)
+            {
+                entry.ops[bursts].type = OP_IO;
+                entry.ops[bursts].time = 0;
+                bursts++;
+            }
+            entry.ops[bursts].type = bursts % 2 == 0 ? OP_CPU : OP_IO;
+            entry.ops[bursts].time = (unsigned int)value;
+            bursts++;
+        }
+        if (bursts % 2 == 0 || p[strspn(p, " \t\r\n")] != '\0')
+        {
+            fprintf(stderr, "%s:%u: bursts must be numbers alternating CPU"
+                    " and I/O, starting and ending with CPU\n", path, line_no);
+            free(entry.ops);
+            free(line);
+            fclose(file);
+            return -1;
+        }
+        entry.ops[bursts].type = OP_TERMINATE;
+        entry.ops[bursts].time = 0;
+
+        entry.name = malloc(strlen(name) + 12);
+        assert(entry.name != NULL);
+        if (entry.thread == 0)
+            strcpy(entry.name, name);
+        else
+            sprintf(entry.name, "%s.%u", name, entry.thread);
+        entry.line = line_no;
+
+        if (count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 64;
+            entries = realloc(entries, sizeof(workload_entry) * capacity);
+            assert(entries != NULL);
+        }
+        entries[count++] = entry;
+    }
+    free(line);
+    fclose(file);
+
+    if (count == 0)
+    {
+        fprintf(stderr, "%s: no processes defined\n", path);
+        return -1;
+    }
+
+    qsort(entries, count, sizeof(workload_entry), compare_arrival);
 
+    processes = malloc(sizeof(pcb_t) * count);
+    assert(processes != NULL);
+    process_count = count;
+    for (n=0; n<count; n++)
+    {
+        /* The threads of a process follow it, since they arrive with it */
+        if (entries[n].thread == 0)
+            tgid = n;
+        pcb_t pcb = { n, entries[n].name, entries[n].ops[0].time, PROCESS_NEW,
+                      entries[n].ops, NULL, entries[n].arrival,
+                      entries[n].priority, entries[n].period,
+                      entries[n].deadline,
+                      entries[n].arrival + entries[n].deadline, tgid };
+        memcpy(&processes[n], &pcb, sizeof(pcb_t));
+    }
+    free(entries);
+    return 0;
+}
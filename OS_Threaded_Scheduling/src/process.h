@@ -9,8 +9,44 @@
 #define __PROCESS_H__
 
 
-#define PROCESS_COUNT 8
-extern pcb_t processes[PROCESS_COUNT];
+/*
+ * The process table is built at runtime by create_processes().  Process i
+ * runs a copy of the i % DEFAULT_PROCESS_COUNT built-in workload and
+ * arrives at tick 10 * i, so the default of DEFAULT_PROCESS_COUNT processes
+ * is the original workload.
+ */
+#define DEFAULT_PROCESS_COUNT 8
+
+extern pcb_t *processes;
+extern unsigned int process_count;
+
+extern void create_processes(unsigned int count);
+
+/*
+ * load_processes() builds the process table from a workload file instead.
+ * Each non-blank line that does not start with '#' defines one process:
+ *
+ *   <name> <arrival tick> <priority> <cpu> [<io> <cpu>]...
+ *
+ * The bursts alternate CPU and I/O times in ticks and must start and end
+ * with a CPU burst.  The latency report puts processes whose names start
+ * with the same character in one class, so e.g. I... and C... names give
+ * an I/O-bound and a CPU-bound class as in the built-in workload.  A
+ * periodic real-time process instead has
+ *
+ *   <name> <arrival tick> <priority> <period>:<deadline> <cpu> [<cpu>]...
+ *
+ * with one CPU burst per job.  Job k is released at arrival + k * period
+ * and must complete within deadline ticks.  A line
+ *
+ *   + <cpu> [<io> <cpu>]...
+ *
+ * adds a thread with its own bursts to the process on the line before.
+ * It is named <name>.<n> and arrives with the process.  Processes are
+ * numbered in order of arrival, each followed by its threads.  Returns 0
+ * on success, or prints the offending line and returns -1.
+ */
+extern int load_processes(const char *path);
 
 
 
@@ -0,0 +1,966 @@
+/*
+ * ready-queue.c
+ * Multithreaded OS Simulation for ECE 3056
+ *
+ * Ready queue structures for the CPU scheduler.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "os-sim.h"
+#include "ready-queue.h"
+
+
+/*
+ * Every queue starts with a ready_queue header, so the rq_* functions can
+ * dispatch through its operations table.
+ */
+typedef struct {
+    void (*push)(ready_queue_t *queue, pcb_t *pcb);
+    pcb_t *(*pop)(ready_queue_t *queue);
+    pcb_t *(*peek)(ready_queue_t *queue);
+    int (*remove)(ready_queue_t *queue, pcb_t *pcb);
+    void (*update)(ready_queue_t *queue, pcb_t *pcb);
+    void (*destroy)(ready_queue_t *queue);
+} ready_queue_ops_t;
+
+struct ready_queue {
+    const ready_queue_ops_t *ops;
+    unsigned int size;
+};
+
+
+/*
+ * The FIFO queue is a singly-linked list through pcb->next with a tail
+ * pointer.
+ */
+typedef struct {
+    ready_queue_t base;
+    pcb_t *head, *tail;
+} fifo_queue_t;
+
+static void fifo_push(ready_queue_t *queue, pcb_t *pcb)
+{
+    fifo_queue_t *fifo = (fifo_queue_t*)queue;
+
+    pcb->next = NULL;
+    if (fifo->tail == NULL)
+        fifo->head = pcb;
+    else
+        fifo->tail->next = pcb;
+    fifo->tail = pcb;
+    queue->size++;
+}
+
+static pcb_t *fifo_pop(ready_queue_t *queue)
+{
+    fifo_queue_t *fifo = (fifo_queue_t*)queue;
+    pcb_t *pcb = fifo->head;
+
+    if (pcb != NULL)
+    {
+        fifo->head = pcb->next;
+        if (fifo->head == NULL)
+            fifo->tail = NULL;
+        pcb->next = NULL;
+        queue->size--;
+    }
+    return pcb;
+}
+
+static pcb_t *fifo_peek(ready_queue_t *queue)
+{
+    return ((fifo_queue_t*)queue)->head;
+}
+
+static int fifo_remove(ready_queue_t *queue, pcb_t *pcb)
+{
+    fifo_queue_t *fifo = (fifo_queue_t*)queue;
+    pcb_t *prev = NULL, *curr = fifo->head;
+
+    while (curr != NULL && curr != pcb)
+    {
+        prev = curr;
+        curr = curr->next;
+    }
+    if (curr == NULL)
+        return 0;
+
+    if (prev == NULL)
+        fifo->head = curr->next;
+    else
+        prev->next = curr->next;
+    if (fifo->tail == curr)
+        fifo->tail = prev;
+    curr->next = NULL;
+    queue->size--;
+    return 1;
+}
+
+static void fifo_update(ready_queue_t *queue, pcb_t *pcb)
+{
+    /* Arrival order does not depend on any key */
+    (void)queue;
+    (void)pcb;
+}
+
+static void fifo_destroy(ready_queue_t *queue)
+{
+    free(queue);
+}
+
+static const ready_queue_ops_t fifo_ops = {
+    fifo_push, fifo_pop, fifo_peek, fifo_remove, fifo_update, fifo_destroy
+};
+
+extern ready_queue_t *rq_create_fifo(void)
+{
+    fifo_queue_t *fifo = malloc(sizeof(fifo_queue_t));
+    assert(fifo != NULL);
+
+    fifo->base.ops = &fifo_ops;
+    fifo->base.size = 0;
+    fifo->head = NULL;
+    fifo->tail = NULL;
+    return &fifo->base;
+}
+
+
+/*
+ * The heap is an array-based binary heap.  index[pid] holds the position
+ * of a PCB in the array plus one, or zero when the PCB is not queued.
+ * Every entry carries its arrival sequence number to break ties in FIFO
+ * order.
+ */
+typedef struct {
+    pcb_t *pcb;
+    unsigned long seq;
+} heap_entry_t;
+
+typedef struct {
+    ready_queue_t base;
+    pcb_before_t before;
+    heap_entry_t *entries;
+    unsigned int *index;
+    unsigned int max_pid;
+    unsigned long seq;
+} heap_queue_t;
+
+static int heap_before(const heap_queue_t *heap, unsigned int a,
+                       unsigned int b)
+{
+    const heap_entry_t *x = &heap->entries[a], *y = &heap->entries[b];
+
+    if (heap->before(x->pcb, y->pcb))
+        return 1;
+    if (heap->before(y->pcb, x->pcb))
+        return 0;
+    return x->seq < y->seq;
+}
+
+static void heap_swap(heap_queue_t *heap, unsigned int a, unsigned int b)
+{
+    heap_entry_t t = heap->entries[a];
+
+    heap->entries[a] = heap->entries[b];
+    heap->entries[b] = t;
+    heap->index[heap->entries[a].pcb->pid] = a + 1;
+    heap->index[heap->entries[b].pcb->pid] = b + 1;
+}
+
+static void heap_sift_up(heap_queue_t *heap, unsigned int n)
+{
+    while (n > 0 && heap_before(heap, n, (n - 1) / 2))
+    {
+        heap_swap(heap, n, (n - 1) / 2);
+        n = (n - 1) / 2;
+    }
+}
+
+static void heap_sift_down(heap_queue_t *heap, unsigned int n)
+{
+    unsigned int child, size = heap->base.size;
+
+    while ((child = 2 * n + 1) < size)
+    {
+        if (child + 1 < size && heap_before(heap, child + 1, child))
+            child++;
+        if (!heap_before(heap, child, n))
+            break;
+        heap_swap(heap, n, child);
+        n = child;
+    }
+}
+
+static void heap_push(ready_queue_t *queue, pcb_t *pcb)
+{
+    heap_queue_t *heap = (heap_queue_t*)queue;
+    unsigned int n = queue->size;
+
+    assert(pcb->pid <= heap->max_pid && heap->index[pcb->pid] == 0);
+    heap->entries[n].pcb = pcb;
+    heap->entries[n].seq = heap->seq++;
+    heap->index[pcb->pid] = n + 1;
+    queue->size++;
+    heap_sift_up(heap, n);
+}
+
+/* Take the entry at position n out of the heap */
+static pcb_t *heap_take(heap_queue_t *heap, unsigned int n)
+{
+    pcb_t *pcb = heap->entries[n].pcb;
+    unsigned int last = --heap->base.size;
+
+    heap->index[pcb->pid] = 0;
+    if (n != last)
+    {
+        heap->entries[n] = heap->entries[last];
+        heap->index[heap->entries[n].pcb->pid] = n + 1;
+        heap_sift_down(heap, n);
+        heap_sift_up(heap, n);
+    }
+    return pcb;
+}
+
+static pcb_t *heap_pop(ready_queue_t *queue)
+{
+    if (queue->size == 0)
+        return NULL;
+    return heap_take((heap_queue_t*)queue, 0);
+}
+
+static pcb_t *heap_peek(ready_queue_t *queue)
+{
+    if (queue->size == 0)
+        return NULL;
+    return ((heap_queue_t*)queue)->entries[0].pcb;
+}
+
+static int heap_remove(ready_queue_t *queue, pcb_t *pcb)
+{
+    heap_queue_t *heap = (heap_queue_t*)queue;
+
+    if (pcb->pid > heap->max_pid || heap->index[pcb->pid] == 0)
+        return 0;
+    heap_take(heap, heap->index[pcb->pid] - 1);
+    return 1;
+}
+
+static void heap_update(ready_queue_t *queue, pcb_t *pcb)
+{
+    heap_queue_t *heap = (heap_queue_t*)queue;
+    unsigned int n;
+
+    if (pcb->pid > heap->max_pid || heap->index[pcb->pid] == 0)
+        return;
+    n = heap->index[pcb->pid] - 1;
+    heap_sift_down(heap, n);
+    heap_sift_up(heap, n);
+}
+
+static void heap_destroy(ready_queue_t *queue)
+{
+    free(((heap_queue_t*)queue)->entries);
+    free(((heap_queue_t*)queue)->index);
+    free(queue);
+}
+
+static const ready_queue_ops_t heap_ops = {
+    heap_push, heap_pop, heap_peek, heap_remove, heap_update, heap_destroy
+};
+
+extern ready_queue_t *rq_create_heap(unsigned int max_pid,
+                                     pcb_before_t before)
+{
+    heap_queue_t *heap = malloc(sizeof(heap_queue_t));
+    assert(heap != NULL);
+
+    heap->base.ops = &heap_ops;
+    heap->base.size = 0;
+    heap->before = before;
+    heap->max_pid = max_pid;
+    heap->seq = 0;
+    heap->entries = malloc(sizeof(heap_entry_t) * (max_pid + 1));
+    heap->index = calloc(max_pid + 1, sizeof(unsigned int));
+    assert(heap->entries != NULL && heap->index != NULL);
+    return &heap->base;
+}
+
+
+/*
+ * The red-black tree keeps its nodes in an array indexed by pid, so no
+ * allocation happens while scheduling.  A node is queued when its pcb is
+ * not NULL.  The leftmost node is cached, so peek is O(1) and pop only
+ * pays for the rebalancing.  Ties are broken by the arrival sequence
+ * number, as in the heap.
+ */
+typedef struct rb_node {
+    pcb_t *pcb;
+    unsigned long seq;
+    struct rb_node *left, *right, *parent;
+    int red;
+} rb_node_t;
+
+typedef struct {
+    ready_queue_t base;
+    pcb_before_t before;
+    rb_node_t *nodes;
+    rb_node_t nil;
+    rb_node_t *root, *leftmost;
+    unsigned int max_pid;
+    unsigned long seq;
+} rbtree_queue_t;
+
+static int rb_before(const rbtree_queue_t *tree, const rb_node_t *x,
+                     const rb_node_t *y)
+{
+    if (tree->before(x->pcb, y->pcb))
+        return 1;
+    if (tree->before(y->pcb, x->pcb))
+        return 0;
+    return x->seq < y->seq;
+}
+
+static rb_node_t *rb_minimum(rbtree_queue_t *tree, rb_node_t *x)
+{
+    while (x->left != &tree->nil)
+        x = x->left;
+    return x;
+}
+
+static void rb_rotate_left(rbtree_queue_t *tree, rb_node_t *x)
+{
+    rb_node_t *y = x->right;
+
+    x->right = y->left;
+    if (y->left != &tree->nil)
+        y->left->parent = x;
+    y->parent = x->parent;
+    if (x->parent == &tree->nil)
+        tree->root = y;
+    else if (x == x->parent->left)
+        x->parent->left = y;
+    else
+        x->parent->right = y;
+    y->left = x;
+    x->parent = y;
+}
+
+static void rb_rotate_right(rbtree_queue_t *tree, rb_node_t *x)
+{
+    rb_node_t *y = x->left;
+
+    x->left = y->right;
+    if (y->right != &tree->nil)
+        y->right->parent = x;
+    y->parent = x->parent;
+    if (x->parent == &tree->nil)
+        tree->root = y;
+    else if (x == x->parent->right)
+        x->parent->right = y;
+    else
+        x->parent->left = y;
+    y->right = x;
+    x->parent = y;
+}
+
+static void rb_insert(rbtree_queue_t *tree, rb_node_t *z)
+{
+    rb_node_t *x = tree->root, *y = &tree->nil, *u;
+    int leftmost = 1;
+
+    while (x != &tree->nil)
+    {
+        y = x;
+        if (rb_before(tree, z, x))
+            x = x->left;
+        else
+        {
+            x = x->right;
+            leftmost = 0;
+        }
+    }
+    z->parent = y;
+    z->left = z->right = &tree->nil;
+    z->red = 1;
+    if (y == &tree->nil)
+        tree->root = z;
+    else if (rb_before(tree, z, y))
+        y->left = z;
+    else
+        y->right = z;
+    if (leftmost)
+        tree->leftmost = z;
+
+    /* Restore the red-black properties */
+    while (z->parent->red)
+    {
+        if (z->parent == z->parent->parent->left)
+        {
+            u = z->parent->parent->right;
+            if (u->red)
+            {
+                z->parent->red = 0;
+                u->red = 0;
+                z->parent->parent->red = 1;
+                z = z->parent->parent;
+            }
+            else
+            {
+                if (z == z->parent->right)
+                {
+                    z = z->parent;
+                    rb_rotate_left(tree, z);
+                }
+                z->parent->red = 0;
+                z->parent->parent->red = 1;
+                rb_rotate_right(tree, z->parent->parent);
+            }
+        }
+        else
+        {
+            u = z->parent->parent->left;
+            if (u->red)
+            {
+                z->parent->red = 0;
+                u->red = 0;
+                z->parent->parent->red = 1;
+                z = z->parent->parent;
+            }
+            else
+            {
+                if (z == z->parent->left)
+                {
+                    z = z->parent;
+                    rb_rotate_right(tree, z);
+                }
+                z->parent->red = 0;
+                z->parent->parent->red = 1;
+                rb_rotate_left(tree, z->parent->parent);
+            }
+        }
+    }
+    tree->root->red = 0;
+}
+
+/* Replace the subtree rooted at u by the one rooted at v */
+static void rb_transplant(rbtree_queue_t *tree, rb_node_t *u, rb_node_t *v)
+{
+    if (u->parent == &tree->nil)
+        tree->root = v;
+    else if (u == u->parent->left)
+        u->parent->left = v;
+    else
+        u->parent->right = v;
+    v->parent = u->parent;
+}
+
+static void rb_erase(rbtree_queue_t *tree, rb_node_t *z)
+{
+    rb_node_t *x, *y = z, *w;
+    int y_red = y->red;
+
+    if (tree->leftmost == z)
+    {
+        /* The leftmost node has no left child, so its successor is either
+         * the minimum of its right subtree or its parent */
+        if (z->right != &tree->nil)
+            tree->leftmost = rb_minimum(tree, z->right);
+        else
+            tree->leftmost = z->parent;
+    }
+
+    if (z->left == &tree->nil)
+    {
+        x = z->right;
+        rb_transplant(tree, z, z->right);
+    }
+    else if (z->right == &tree->nil)
+    {
+        x = z->left;
+        rb_transplant(tree, z, z->left);
+    }
+    else
+    {
+        y = rb_minimum(tree, z->right);
+        y_red = y->red;
+        x = y->right;
+        if (y->parent == z)
+            x->parent = y;
+        else
+        {
+            rb_transplant(tree, y, y->right);
+            y->right = z->right;
+            y->right->parent = y;
+        }
+        rb_transplant(tree, z, y);
+        y->left = z->left;
+        y->left->parent = y;
+        y->red = z->red;
+    }
+
+    if (!y_red)
+    {
+        /* Restore the red-black properties */
+        while (x != tree->root && !x->red)
+        {
+            if (x == x->parent->left)
+            {
+                w = x->parent->right;
+                if (w->red)
+                {
+                    w->red = 0;
+                    x->parent->red = 1;
+                    rb_rotate_left(tree, x->parent);
+                    w = x->parent->right;
+                }
+                if (!w->left->red && !w->right->red)
+                {
+                    w->red = 1;
+                    x = x->parent;
+                }
+                else
+                {
+                    if (!w->right->red)
+                    {
+                        w->left->red = 0;
+                        w->red = 1;
+                        rb_rotate_right(tree, w);
+                        w = x->parent->right;
+                    }
+                    w->red = x->parent->red;
+                    x->parent->red = 0;
+                    w->right->red = 0;
+                    rb_rotate_left(tree, x->parent);
+                    x = tree->root;
+                }
+            }
+            else
+            {
+                w = x->parent->left;
+                if (w->red)
+                {
+                    w->red = 0;
+                    x->parent->red = 1;
+                    rb_rotate_right(tree, x->parent);
+                    w = x->parent->left;
+                }
+                if (!w->right->red && !w->left->red)
+                {
+                    w->red = 1;
+                    x = x->parent;
+                }
+                else
+                {
+                    if (!w->left->red)
+                    {
+                        w->right->red = 0;
+                        w->red = 1;
+                        rb_rotate_left(tree, w);
+                        w = x->parent->left;
+                    }
+                    w->red = x->parent->red;
+                    x->parent->red = 0;
+                    w->left->red = 0;
+                    rb_rotate_right(tree, x->parent);
+                    x = tree->root;
+                }
+            }
+        }
+        x->red = 0;
+    }
+
+    z->pcb = NULL;
+    if (tree->root == &tree->nil)
+        tree->leftmost = &tree->nil;
+}
+
+static void rbtree_push(ready_queue_t *queue, pcb_t *pcb)
+{
+    rbtree_queue_t *tree = (rbtree_queue_t*)queue;
+    rb_node_t *node;
+
+    assert(pcb->pid <= tree->max_pid && tree->nodes[pcb->pid].pcb == NULL);
+    node = &tree->nodes[pcb->pid];
+    node->pcb = pcb;
+    node->seq = tree->seq++;
+    rb_insert(tree, node);
+    queue->size++;
+}
+
+static pcb_t *rbtree_pop(ready_queue_t *queue)
+{
+    rbtree_queue_t *tree = (rbtree_queue_t*)queue;
+    pcb_t *pcb;
+
+    if (queue->size == 0)
+        return NULL;
+    pcb = tree->leftmost->pcb;
+    rb_erase(tree, tree->leftmost);
+    queue->size--;
+    return pcb;
+}
+
+static pcb_t *rbtree_peek(ready_queue_t *queue)
+{
+    if (queue->size == 0)
+        return NULL;
+    return ((rbtree_queue_t*)queue)->leftmost->pcb;
+}
+
+static int rbtree_remove(ready_queue_t *queue, pcb_t *pcb)
+{
+    rbtree_queue_t *tree = (rbtree_queue_t*)queue;
+
+    if (pcb->pid > tree->max_pid || tree->nodes[pcb->pid].pcb == NULL)
+        return 0;
+    rb_erase(tree, &tree->nodes[pcb->pid]);
+    queue->size--;
+    return 1;
+}
+
+static void rbtree_update(ready_queue_t *queue, pcb_t *pcb)
+{
+    rbtree_queue_t *tree = (rbtree_queue_t*)queue;
+    rb_node_t *node;
+
+    if (pcb->pid > tree->max_pid || tree->nodes[pcb->pid].pcb == NULL)
+        return;
+    /* Re-insert with the same sequence number to keep ties in order */
+    node = &tree->nodes[pcb->pid];
+    rb_erase(tree, node);
+    node->pcb = pcb;
+    rb_insert(tree, node);
+}
+
+static void rbtree_destroy(ready_queue_t *queue)
+{
+    free(((rbtree_queue_t*)queue)->nodes);
+    free(queue);
+}
+
+static const ready_queue_ops_t rbtree_ops = {
+    rbtree_push, rbtree_pop, rbtree_peek, rbtree_remove, rbtree_update,
+    rbtree_destroy
+};
+
+extern ready_queue_t *rq_create_rbtree(unsigned int max_pid,
+                                       pcb_before_t before)
+{
+    rbtree_queue_t *tree = malloc(sizeof(rbtree_queue_t));
+    assert(tree != NULL);
+
+    tree->base.ops = &rbtree_ops;
+    tree->base.size = 0;
+    tree->before = before;
+    tree->max_pid = max_pid;
+    tree->seq = 0;
+    tree->nil.pcb = NULL;
+    tree->nil.red = 0;
+    tree->nil.left = tree->nil.right = tree->nil.parent = &tree->nil;
+    tree->root = tree->leftmost = &tree->nil;
+    tree->nodes = calloc(max_pid + 1, sizeof(rb_node_t));
+    assert(tree->nodes != NULL);
+    return &tree->base;
+}
+
+
+/*
+ * The multilevel queue is an array of FIFO queues, one per priority level.
+ * A PCB is queued at the level level_of() returns when it is pushed, and
+ * pop takes from the highest priority (lowest numbered) non-empty level.
+ */
+typedef struct {
+    ready_queue_t base;
+    pcb_level_t level_of;
+    ready_queue_t **levels;
+    unsigned int level_count;
+} multilevel_queue_t;
+
+static void multilevel_push(ready_queue_t *queue, pcb_t *pcb)
+{
+    multilevel_queue_t *mlq = (multilevel_queue_t*)queue;
+    unsigned int level = mlq->level_of(pcb);
+
+    if (level >= mlq->level_count)
+        level = mlq->level_count - 1;
+    rq_push(mlq->levels[level], pcb);
+    queue->size++;
+}
+
+static pcb_t *multilevel_pop(ready_queue_t *queue)
+{
+    multilevel_queue_t *mlq = (multilevel_queue_t*)queue;
+    unsigned int level;
+
+    if (queue->size == 0)
+        return NULL;
+    for (level=0; rq_size(mlq->levels[level]) == 0; level++)
+        ;
+    queue->size--;
+    return rq_pop(mlq->levels[level]);
+}
+
+static pcb_t *multilevel_peek(ready_queue_t *queue)
+{
+    multilevel_queue_t *mlq = (multilevel_queue_t*)queue;
+    unsigned int level;
+
+    if (queue->size == 0)
+        return NULL;
+    for (level=0; rq_size(mlq->levels[level]) == 0; level++)
+        ;
+    return rq_peek(mlq->levels[level]);
+}
+
+static int multilevel_remove(ready_queue_t *queue, pcb_t *pcb)
+{
+    multilevel_queue_t *mlq = (multilevel_queue_t*)queue;
+    unsigned int level;
+
+    for (level=0; level<mlq->level_count; level++)
+    {
+        if (rq_remove(mlq->levels[level], pcb))
+        {
+            queue->size--;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void multilevel_update(ready_queue_t *queue, pcb_t *pcb)
+{
+    /* Move the PCB to the back of its new level */
+    if (multilevel_remove(queue, pcb))
+        multilevel_push(queue, pcb);
+}
+
+static void multilevel_destroy(ready_queue_t *queue)
+{
+    multilevel_queue_t *mlq = (multilevel_queue_t*)queue;
+    unsigned int level;
+
+    for (level=0; level<mlq->level_count; level++)
+        rq_destroy(mlq->levels[level]);
+    free(mlq->levels);
+    free(queue);
+}
+
+static const ready_queue_ops_t multilevel_ops = {
+    multilevel_push, multilevel_pop, multilevel_peek, multilevel_remove,
+    multilevel_update, multilevel_destroy
+};
+
+extern ready_queue_t *rq_create_multilevel(unsigned int level_count,
+                                           pcb_level_t level_of)
+{
+    multilevel_queue_t *mlq = malloc(sizeof(multilevel_queue_t));
+    unsigned int level;
+
+    assert(mlq != NULL && level_count > 0);
+    mlq->base.ops = &multilevel_ops;
+    mlq->base.size = 0;
+    mlq->level_of = level_of;
+    mlq->level_count = level_count;
+    mlq->levels = malloc(sizeof(ready_queue_t*) * level_count);
+    assert(mlq->levels != NULL);
+    for (level=0; level<level_count; level++)
+        mlq->levels[level] = rq_create_fifo();
+    return &mlq->base;
+}
+
+
+/*
+ * The MPMC queue is a bounded ring of cells, each with a sequence number
+ * (D. Vyukov's design).  A producer may fill the cell at tail when its
+ * sequence equals tail, and publishes it by setting the sequence to
+ * tail + 1; a consumer may empty the cell at head when its sequence is
+ * head + 1, and recycles it by setting it to head + capacity.  head and
+ * tail are claimed with a compare-and-swap, so any number of threads can
+ * push and pop without a lock.  head and tail sit on separate cache lines
+ * so producers and consumers do not invalidate each other.
+ */
+typedef struct {
+    unsigned long seq;
+    pcb_t *pcb;
+} mpmc_cell_t;
+
+typedef struct {
+    ready_queue_t base;
+    mpmc_cell_t *cells;
+    unsigned long mask;
+    char pad0[64];
+    unsigned long head;
+    char pad1[64];
+    unsigned long tail;
+    char pad2[64];
+} mpmc_queue_t;
+
+static void mpmc_push(ready_queue_t *queue, pcb_t *pcb)
+{
+    mpmc_queue_t *mpmc = (mpmc_queue_t*)queue;
+    unsigned long pos, seq;
+    mpmc_cell_t *cell;
+    long diff;
+
+    pos = __atomic_load_n(&mpmc->tail, __ATOMIC_RELAXED);
+    while (1)
+    {
+        cell = &mpmc->cells[pos & mpmc->mask];
+        seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        diff = (long)(seq - pos);
+        if (diff == 0)
+        {
+            if (__atomic_compare_exchange_n(&mpmc->tail, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED))
+                break;
+        }
+        else
+        {
+            /*
+             * A PCB is queued at most once, so the ring never really fills
+             * up.  diff < 0 means the cell is still being emptied by a
+             * consumer a whole lap behind, and it will be free shortly.
+             */
+            pos = __atomic_load_n(&mpmc->tail, __ATOMIC_RELAXED);
+        }
+    }
+    cell->pcb = pcb;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&queue->size, 1, __ATOMIC_RELAXED);
+}
+
+static pcb_t *mpmc_pop(ready_queue_t *queue)
+{
+    mpmc_queue_t *mpmc = (mpmc_queue_t*)queue;
+    unsigned long pos, seq;
+    mpmc_cell_t *cell;
+    pcb_t *pcb;
+    long diff;
+
+    pos = __atomic_load_n(&mpmc->head, __ATOMIC_RELAXED);
+    while (1)
+    {
+        cell = &mpmc->cells[pos & mpmc->mask];
+        seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        diff = (long)(seq - (pos + 1));
+        if (diff == 0)
+        {
+            if (__atomic_compare_exchange_n(&mpmc->head, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED))
+                break;
+        }
+        else if (diff < 0)
+            return NULL;
+        else
+            pos = __atomic_load_n(&mpmc->head, __ATOMIC_RELAXED);
+    }
+    pcb = cell->pcb;
+    __atomic_store_n(&cell->seq, pos + mpmc->mask + 1, __ATOMIC_RELEASE);
+    __atomic_sub_fetch(&queue->size, 1, __ATOMIC_RELAXED);
+    return pcb;
+}
+
+static pcb_t *mpmc_peek(ready_queue_t *queue)
+{
+    mpmc_queue_t *mpmc = (mpmc_queue_t*)queue;
+    unsigned long pos;
+    mpmc_cell_t *cell;
+
+    /* Only a snapshot: the PCB may be popped by the time it is used */
+    pos = __atomic_load_n(&mpmc->head, __ATOMIC_RELAXED);
+    cell = &mpmc->cells[pos & mpmc->mask];
+    if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != pos + 1)
+        return NULL;
+    return cell->pcb;
+}
+
+static int mpmc_remove(ready_queue_t *queue, pcb_t *pcb)
+{
+    /* A PCB in the middle of the ring cannot be taken out lock-free */
+    (void)queue;
+    (void)pcb;
+    assert(!"rq_remove() is not supported by the MPMC queue");
+    return 0;
+}
+
+static void mpmc_update(ready_queue_t *queue, pcb_t *pcb)
+{
+    /* Arrival order does not depend on any key */
+    (void)queue;
+    (void)pcb;
+}
+
+static void mpmc_destroy(ready_queue_t *queue)
+{
+    free(((mpmc_queue_t*)queue)->cells);
+    free(queue);
+}
+
+static const ready_queue_ops_t mpmc_ops = {
+    mpmc_push, mpmc_pop, mpmc_peek, mpmc_remove, mpmc_update, mpmc_destroy
+};
+
+extern ready_queue_t *rq_create_mpmc(unsigned int capacity)
+{
+    mpmc_queue_t *mpmc = malloc(sizeof(mpmc_queue_t));
+    unsigned long size = 1, n;
+
+    assert(mpmc != NULL);
+    while (size < capacity)
+        size *= 2;
+
+    mpmc->base.ops = &mpmc_ops;
+    mpmc->base.size = 0;
+    mpmc->mask = size - 1;
+    mpmc->head = 0;
+    mpmc->tail = 0;
+    mpmc->cells = malloc(sizeof(mpmc_cell_t) * size);
+    assert(mpmc->cells != NULL);
+    for (n=0; n<size; n++)
+    {
+        mpmc->cells[n].seq = n;
+        mpmc->cells[n].pcb = NULL;
+    }
+    return &mpmc->base;
+}
+
+
+extern void rq_destroy(ready_queue_t *queue)
+{
+    queue->ops->destroy(queue);
+}
+
+extern void rq_push(ready_queue_t *queue, pcb_t *pcb)
+{
+    queue->ops->push(queue, pcb);
+}
+
+extern pcb_t *rq_pop(ready_queue_t *queue)
+{
+    return queue->ops->pop(queue);
+}
+
+extern pcb_t *rq_peek(ready_queue_t *queue)
+{
+    return queue->ops->peek(queue);
+}
+
+extern int rq_remove(ready_queue_t *queue, pcb_t *pcb)
+{
+    return queue->ops->remove(queue, pcb);
+}
+
+extern void rq_update(ready_queue_t *queue, pcb_t *pcb)
+{
+    queue->ops->update(queue, pcb);
+}
+
+extern unsigned int rq_size(const ready_queue_t *queue)
+{
+    return __atomic_load_n(&queue->size, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,81 @@
+/*
+ * ready-queue.h
+ * Multithreaded OS Simulation for ECE 3056
+ *
+ * Ready queue structures for the CPU scheduler.  A queue is created with
+ * one of the constructors below and then used through the rq_* functions,
+ * so the scheduler does not depend on how the queue is organised.
+ *
+ * Only the MPMC queue is thread-safe; for the others the caller provides
+ * the locking.
+ */
+
+#ifndef __READY_QUEUE_H__
+#define __READY_QUEUE_H__
+
+#include "os-sim.h"
+
+typedef struct ready_queue ready_queue_t;
+
+/*
+ * pcb_before_t orders the PCBs in a heap: it returns nonzero when a should
+ * run before b.  PCBs that compare equal leave in the order they arrived.
+ */
+typedef int (*pcb_before_t)(const pcb_t *a, const pcb_t *b);
+
+/*
+ * pcb_level_t returns the priority level of a PCB in a multilevel queue,
+ * 0 being the highest.
+ */
+typedef unsigned int (*pcb_level_t)(const pcb_t *pcb);
+
+/*
+ * rq_create_fifo() creates a FIFO queue.  It links PCBs through their next
+ * pointer and keeps a tail pointer, so push and pop are O(1).
+ *
+ * rq_create_heap() creates a binary heap ordered by before().  Push and pop
+ * are O(log n).  The heap is indexed by pid, so max_pid is the largest pid
+ * it will ever hold, and any PCB can be removed or re-keyed in O(log n).
+ *
+ * rq_create_rbtree() creates a red-black tree ordered by before(), indexed
+ * by pid like the heap.  Push, pop and remove are O(log n) and peek at the
+ * cached leftmost PCB is O(1).
+ *
+ * rq_create_multilevel() creates level_count FIFO queues.  A PCB joins the
+ * back of the level that level_of() returns when it is pushed, and pop
+ * takes from the highest priority level that is not empty.  Push is O(1)
+ * and pop O(level_count).
+ *
+ * rq_create_mpmc() creates a lock-free FIFO that any number of threads may
+ * push to and pop from concurrently.  It is a bounded ring of capacity
+ * slots, so capacity must be at least the number of PCBs it will ever hold
+ * at once.  rq_peek() only returns a snapshot, rq_size() is approximate
+ * while other threads are active, and rq_remove() is not supported.  It is
+ * experimental, see tools/rq-bench.c.
+ */
+extern ready_queue_t *rq_create_fifo(void);
+extern ready_queue_t *rq_create_heap(unsigned int max_pid,
+                                     pcb_before_t before);
+extern ready_queue_t *rq_create_rbtree(unsigned int max_pid,
+                                       pcb_before_t before);
+extern ready_queue_t *rq_create_multilevel(unsigned int level_count,
+                                           pcb_level_t level_of);
+extern ready_queue_t *rq_create_mpmc(unsigned int capacity);
+extern void rq_destroy(ready_queue_t *queue);
+
+/*
+ * rq_push() adds a PCB, rq_pop() removes and returns the PCB that should
+ * run next (NULL when empty), and rq_peek() returns it without removing it.
+ *
+ * rq_remove() takes a specific PCB out of the queue and returns nonzero if
+ * it was queued.  rq_update() restores the order after the key of a queued
+ * PCB changed.  Both are O(n) for a FIFO or a multilevel queue.
+ */
+extern void rq_push(ready_queue_t *queue, pcb_t *pcb);
+extern pcb_t *rq_pop(ready_queue_t *queue);
+extern pcb_t *rq_peek(ready_queue_t *queue);
+extern int rq_remove(ready_queue_t *queue, pcb_t *pcb);
+extern void rq_update(ready_queue_t *queue, pcb_t *pcb);
+extern unsigned int rq_size(const ready_queue_t *queue);
+
+#endif /* __READY_QUEUE_H__ */
@@ -0,0 +1,72 @@
+/*
+ * scheduler.h
+ * Multithreaded OS Simulation for ECE 3056
+ *
+ * The interface of scheduling policies loaded at run time with --sched.
+ * A policy is a shared object that exports a scheduler_ops_t named
+ * scheduler_ops.  It may use the ready queues of ready-queue.h and the
+ * simulator functions of os-sim.h, which os-sim exports to it.
+ *
+ * The scheduler calls the hooks with one lock held, so a policy does not
+ * need any locking of its own.  That lock is shared by all CPUs, so a
+ * loaded policy has a single ready queue: os-sim rejects --sched with -p,
+ * -g and --lock-free.  A policy only decides the order in which processes
+ * run; the scheduler keeps the process states, wakes idle CPUs and calls
+ * context_switch() and force_preempt().
+ *
+ * The built-in policies of student.c are scheduler_ops_t tables too.
+ */
+
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include "os-sim.h"
+
+/* Bumped whenever scheduler_ops_t changes */
+#define SCHEDULER_ABI_VERSION 2
+
+/*
+ *        abi_version : SCHEDULER_ABI_VERSION when the policy was built
+ *
+ *               name : The name of the policy, for the reports
+ *
+ *               init : Called once before the simulation starts.  Returns
+ *                      0, or nonzero to abort.  Pids run from 0 to
+ *                      process_count - 1.
+ *
+ *            enqueue : Adds a ready process.  cpu_id is the CPU it last ran
+ *                      on, or the one the scheduler suggests for a new one.
+ *
+ *          pick_next : Removes and returns the process to run next on
+ *                      cpu_id, or NULL to idle.  *time_slice holds the
+ *                      default slice (-1 for none, or the -r value) and
+ *                      may be changed for this process.
+ *
+ *         on_preempt : A running process's time slice expired, or it was
+ *                      preempted.  It is enqueued again right after.
+ *
+ *           on_yield : A running process started an I/O request.
+ *
+ *            on_wake : A process finished its I/O or was created.  It is
+ *                      enqueued for cpu_id right after.
+ *
+ *     should_preempt : Returns nonzero if woken should preempt running.
+ *                      If no CPU is idle, it also ranks the running
+ *                      processes, and the one ranked last is preempted if
+ *                      woken should preempt it.  May be NULL.
+ *
+ * Any hook but init, enqueue and pick_next may be NULL.
+ */
+typedef struct {
+    unsigned int abi_version;
+    const char *name;
+    int (*init)(unsigned int cpu_count, unsigned int process_count);
+    void (*enqueue)(pcb_t *pcb, unsigned int cpu_id);
+    pcb_t *(*pick_next)(unsigned int cpu_id, int *time_slice);
+    void (*on_preempt)(pcb_t *pcb, unsigned int cpu_id);
+    void (*on_yield)(pcb_t *pcb, unsigned int cpu_id);
+    void (*on_wake)(pcb_t *pcb, unsigned int cpu_id);
+    int (*should_preempt)(const pcb_t *woken, const pcb_t *running);
+} scheduler_ops_t;
+
+#endif /* __SCHEDULER_H__ */
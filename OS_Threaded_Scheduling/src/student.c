@@ -8,11 +8,18 @@
  */
 
 #include <assert.h>
+#include <dlfcn.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
+#include "lockstat.h"
 #include "os-sim.h"
+#include "process.h"
+#include "ready-queue.h"
+#include "scheduler.h"
 
 /** Function prototypes **/
 extern void idle(unsigned int cpu_id);
@@ -20,9 +27,66 @@ extern void preempt(unsigned int cpu_id);
 extern void yield(unsigned int cpu_id);
 extern void terminate(unsigned int cpu_id);
 extern void wake_up(pcb_t *process);
+extern void print_scheduler_stats(void);
 
-static void push_to_queue(pcb_t *pcb);
-static pcb_t* pop_from_queue();
+static void push_to_queue(pcb_t *pcb, unsigned int cpu_id, int wake);
+static void run_queue_enqueue(pcb_t *pcb, unsigned int cpu_id);
+static pcb_t* run_queue_pick_next(unsigned int cpu_id, int *slice);
+static pcb_t* pop_from_queue(unsigned int cpu_id);
+static pcb_t* steal_from_queue(unsigned int cpu_id);
+static pcb_t* take_from_queue(unsigned int queue_id);
+static void lock_run_queue(unsigned int queue_id);
+static void unlock_run_queue(unsigned int queue_id);
+static pcb_t* running_on(unsigned int cpu_id);
+static void wake_idle_cpu(unsigned int cpu_id);
+static void kick_idle_cpu(unsigned int cpu_id);
+static int claim_idle_cpu(unsigned int cpu_id);
+static void check_preempt(const pcb_t *process);
+static int create_ordered_queues(ready_queue_t *(*create)(unsigned int,
+                                                          pcb_before_t),
+                                 pcb_before_t before, unsigned int count);
+static int fifo_init(unsigned int cpus, unsigned int count);
+static int lrtf_init(unsigned int cpus, unsigned int count);
+static int longer_remaining_time(const pcb_t *a, const pcb_t *b);
+static int srtf_init(unsigned int cpus, unsigned int count);
+static int shorter_remaining_time(const pcb_t *a, const pcb_t *b);
+static int priority_init(unsigned int cpus, unsigned int count);
+static int higher_aged_priority(const pcb_t *a, const pcb_t *b);
+static int higher_priority(const pcb_t *a, const pcb_t *b);
+static int edf_init(unsigned int cpus, unsigned int count);
+static int earlier_deadline(const pcb_t *a, const pcb_t *b);
+static unsigned int deadline_of(const pcb_t *pcb);
+static int admit_task_set(void);
+static int cfs_init(unsigned int cpus, unsigned int count);
+static void cfs_enqueue(pcb_t *pcb, unsigned int cpu_id);
+static pcb_t* cfs_pick_next(unsigned int cpu_id, int *slice);
+static int smaller_vruntime(const pcb_t *a, const pcb_t *b);
+static int cfs_should_preempt(const pcb_t *woken, const pcb_t *running);
+static unsigned long long current_vruntime(const pcb_t *pcb);
+static unsigned int process_weight(const pcb_t *pcb);
+static void account_runtime(pcb_t *pcb, unsigned int cpu_id);
+static void place_process(pcb_t *pcb, unsigned int cpu_id);
+static int cfs_time_slice(const pcb_t *pcb, unsigned int cpu_id);
+static int mlfq_init(unsigned int cpus, unsigned int count);
+static pcb_t* mlfq_pick_next(unsigned int cpu_id, int *slice);
+static void mlfq_on_preempt(pcb_t *pcb, unsigned int cpu_id);
+static int higher_level(const pcb_t *a, const pcb_t *b);
+static unsigned int mlfq_level_of(const pcb_t *pcb);
+static void mlfq_boost(void);
+static unsigned int energy_aware_cpu(const pcb_t *process);
+static int io_bound(const pcb_t *pcb);
+static int gang_slice(const pcb_t *pcb, int slice);
+static void coschedule(unsigned int tgid);
+static int place_thread(pcb_t *thread, unsigned int tgid);
+static int gang_pending(unsigned int cpu_id);
+static int load_scheduler(const char *path);
+static int plugin_init(unsigned int cpus, unsigned int count);
+static void plugin_enqueue(pcb_t *pcb, unsigned int cpu_id);
+static pcb_t* plugin_pick_next(unsigned int cpu_id, int *slice);
+static void plugin_on_preempt(pcb_t *pcb, unsigned int cpu_id);
+static void plugin_on_yield(pcb_t *pcb, unsigned int cpu_id);
+static void plugin_on_wake(pcb_t *pcb, unsigned int cpu_id);
+static int plugin_should_preempt(const pcb_t *woken, const pcb_t *running);
 
 
 /*
@@ -30,125 +94,1170 @@ static pcb_t* pop_from_queue();
  * There is one array element corresponding to each CPU in the simulation.
  *
  * current[] should be updated by schedule() each time a process is scheduled
- * on a CPU.  Since the current[] array is accessed by multiple threads, you
- * will need to use a mutex to protect it.  current_mutex has been provided
- * for your use.
+ * on a CPU.  Only CPU n writes current[n], so the elements are plain
+ * atomics: schedule() publishes with a release store and running_on()
+ * reads with an acquire load, without a mutex.
  */
 static pcb_t **current;
-static pthread_mutex_t current_mutex;
-static pcb_t *head;
-static pthread_mutex_t ready_mutex;
-static pthread_cond_t not_idle;
+
+static pcb_t* running_on(unsigned int cpu_id)
+{
+    return __atomic_load_n(&current[cpu_id], __ATOMIC_ACQUIRE);
+}
+
+/*
+ * The ready queue is split into run queues, each with its own mutex.  By
+ * default there is a single run queue shared by every CPU.  With -p there
+ * is one per CPU: a process is queued on the CPU it last ran on, and a CPU
+ * whose own queue is empty steals from the longest queue.
+ *
+ * queued counts the processes in all run queues.  It is updated atomically,
+ * so an idle CPU can check for work without taking any run queue lock.
+ * queue_of[] is the run queue each process was last pushed to.
+ */
+typedef struct {
+    ready_queue_t *queue;
+    pthread_mutex_t mutex;
+    unsigned int length;
+    unsigned long enqueued, dispatched, stolen;
+    unsigned long acquired, contended;
+    unsigned long long min_vruntime;
+    unsigned long load;
+    IF_LOCKSTAT(lockstat_t lockstat;)
+} run_queue_t;
+
+static run_queue_t *run_queues;
+static unsigned int run_queue_count;
+static int per_cpu_queues;
+static int lock_free;
+static int *last_cpu;
+static unsigned int queued;
+static unsigned int *queue_of;
+static unsigned long imbalance_sum, imbalance_samples;
+
+/*
+ * Idle CPUs park on their own condition variable, and idle_mask has bit n
+ * set while CPU n is parked.  A push claims one idle CPU by clearing its
+ * bit, preferring the CPU the process was queued for, and wakes only that
+ * one.  With --broadcast-wakeup every idle CPU is claimed instead, which
+ * behaves like the old broadcast and serves as the baseline.
+ *
+ * A CPU sets its bit before it checks queued and a push increments queued
+ * before it looks at the mask, so at least one of them sees the other.
+ * kicked records the wakeup, so it is not lost if it comes before the CPU
+ * is waiting.  kick_time measures the wall-clock wake-up latency.
+ */
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t wakeup;
+    int kicked;
+    struct timespec kick_time;
+} idle_cpu_t;
+
+#define MASK_BITS (8 * sizeof(unsigned long))
+
+static idle_cpu_t *idle_cpus;
+static unsigned long *idle_mask;
+static unsigned int idle_mask_words;
+static int broadcast_wakeup;
+
+static void account_wakeup(idle_cpu_t *idle_cpu);
+
+/* --sched-stats adds the lock and wakeup counts to the final statistics */
+static int sched_stats;
+static unsigned long kicks, wakeups, futile_wakeups;
+static unsigned long long wakeup_latency_sum, wakeup_latency_max;
 
 static int time_slice;
-static int cpu_count;
+static unsigned int cpu_count;
 static char scheduling_alg;
 
 /*
- * schedule() is your CPU scheduler.  It should perform the following tasks:
- *
- *   1. Select and remove a runnable process from your ready queue which
- *	you will have to implement with a linked list or something of the sort.
- *
- *   2. Set the process state to RUNNING
- *
- *   3. Call context_switch(), to tell the simulator which process to execute
- *      next on the CPU.  If no process is runnable, call context_switch()
- *      with a pointer to NULL to select the idle process.
- *	The current array (see above) is how you access the currently running process indexed by the cpu id.
- *	See above for full description.
- *	context_switch() is prototyped in os-sim.h. Look there for more information
- *	about it and its parameters.
+ * CFS gives every process a virtual runtime: the CPU time it received,
+ * scaled by NICE_0_WEIGHT / weight so that heavier (lower nice) processes
+ * age slower.  The run queues are red-black trees ordered by vruntime, and
+ * each one tracks its total queued weight and a monotonic min_vruntime
+ * that new and waking processes are placed relative to.
+ *
+ * A process runs for its share of target_latency, weighted against the
+ * processes waiting in its run queue, but at least min_granularity ticks.
+ * vruntime is kept in 1/VRUNTIME_SCALE ticks of a nice 0 process.
+ */
+#define NICE_0_WEIGHT 1024
+#define VRUNTIME_SCALE 1024
+
+static const unsigned int nice_to_weight[40] = {
+    /* -20 */ 88761, 71755, 56483, 46273, 36291,
+    /* -15 */ 29154, 23254, 18705, 14949, 11916,
+    /* -10 */ 9548, 7620, 6100, 4904, 3906,
+    /*  -5 */ 3121, 2501, 1991, 1586, 1277,
+    /*   0 */ 1024, 820, 655, 526, 423,
+    /*   5 */ 335, 272, 215, 172, 137,
+    /*  10 */ 110, 87, 70, 56, 45,
+    /*  15 */ 36, 29, 23, 18, 15
+};
+
+static unsigned long long *vruntime;
+static unsigned int target_latency;
+static const unsigned int min_granularity = 1;
+
+/*
+ * MLFQ keeps mlfq_levels FIFO levels per run queue.  Level n has a quantum
+ * of mlfq_quantum << n ticks.  A process that uses up its quantum drops a
+ * level, one that yields for I/O keeps its level, and every boost_period
+ * ticks all processes go back to the top level so none starve.
+ */
+static unsigned int mlfq_levels;
+static unsigned int mlfq_quantum = 2;
+static unsigned int boost_period = 50;
+static unsigned int *mlfq_level;
+static int *mlfq_slice;
+static pcb_t **boost_buffer;
+static unsigned int last_boost;
+static unsigned long boosts;
+static unsigned long *level_dispatched;
+
+/*
+ * The priority scheduler runs the lowest priority value first.  A waiting
+ * process gains one priority level every aging_interval ticks, so its
+ * effective priority is priority - (now - enqueued) / aging_interval.
+ * Ordering by priority * aging_interval + enqueued gives the same order
+ * without depending on now, so the heap never has to be re-keyed.
+ */
+static unsigned int aging_interval;
+static unsigned int *enqueue_time;
+
+/*
+ * EDF runs the job with the earliest absolute deadline first.  Processes
+ * without a period have no deadline and only run when no job is ready.
+ * Admission control rejects a task set whose utilization, the sum of
+ * worst-case burst / period, exceeds the bound for global EDF on cpu_count
+ * CPUs: cpu_count - (cpu_count - 1) * the largest single utilization,
+ * which is 1 on a single CPU.
+ */
+static int admission_control = 1;
+
+/*
+ * With --energy-aware, CPU-bound processes wake up on the fastest cores
+ * and I/O-bound ones on the slowest, and a CPU runs an I/O-bound process at
+ * its lowest DVFS level: its bursts are short and it mostly waits for I/O,
+ * so running it fast saves little time for a lot of energy.  Idle CPUs
+ * still take any work, so no process waits for its preferred core.
+ *
+ * A process is I/O-bound once it has spent more ticks blocked than running,
+ * as observed by the scheduler: cpu_ticks[] adds up the ticks it ran per
+ * dispatch, and blocked_ticks[] the time from each yield() to its wake_up().
+ * Until it first blocks, a process counts as CPU-bound.
+ */
+static int energy_aware;
+static unsigned long preferred_placements, placements;
+static unsigned long long *cpu_ticks, *blocked_ticks;
+static unsigned int *blocked_since;
+
+/*
+ * Gang scheduling (-g) runs the threads of a process together.  When one
+ * thread is dispatched, every other ready thread of its process is taken
+ * off the run queues and handed to a CPU of its own through gang_slot[],
+ * an idle CPU if there is one, otherwise one running another process,
+ * which is preempted.  A CPU always runs its gang_slot[] thread next.
+ *
+ * gang_running[] counts the running threads of each process, by tgid.  The
+ * first thread to run sets gang_expiry[] to the end of its time slice, and
+ * threads joining later only get the rest of it, so the whole gang is
+ * preempted on the same tick.  queue_of[] finds the run queue of a ready
+ * thread.
+ */
+static int gang_scheduling;
+static pcb_t **gang_slot;
+static unsigned int *gang_running, *gang_expiry;
+static unsigned long gang_coscheduled, gang_displaced, gang_unplaced;
+
+/*
+ * Every policy is a scheduler_ops_t (see scheduler.h), and policy is the
+ * one in use.  The built-in policies, defined before main(), keep their
+ * processes in the run queues and take the run queue locks themselves.
+ *
+ * --sched loads the policy sched_ops from a shared object instead.  It
+ * keeps its own ready queue, and plugin_ops wraps it so that the lock of
+ * run queue 0 serializes every call into it.  That lock is one for all
+ * CPUs, so a loaded policy cannot be combined with -p, -g or --lock-free.
+ */
+static const scheduler_ops_t *policy;
+static const scheduler_ops_t *sched_ops;
+static scheduler_ops_t plugin_ops;
+
+/*
+ * schedule() is your CPU scheduler.  It should perform the following tasks:
+ *
+ *   1. Select and remove a runnable process from your ready queue which
+ *	you will have to implement with a linked list or something of the sort.
+ *
+ *   2. Set the process state to RUNNING
+ *
+ *   3. Call context_switch(), to tell the simulator which process to execute
+ *      next on the CPU.  If no process is runnable, call context_switch()
+ *      with a pointer to NULL to select the idle process.
+ *	The current array (see above) is how you access the currently running process indexed by the cpu id.
+ *	See above for full description.
+ *	context_switch() is prototyped in os-sim.h. Look there for more information
+ *	about it and its parameters.
+ */
+
+static pcb_t* schedule(unsigned int cpu_id)
+{
+    pcb_t *pcb = NULL;
+    int slice = time_slice;
+
+    if(gang_scheduling) {
+        pcb = __atomic_exchange_n(&gang_slot[cpu_id], NULL, __ATOMIC_ACQ_REL);
+    }
+    if(pcb == NULL) {
+        pcb = policy->pick_next(cpu_id, &slice);
+    }
+
+    if(pcb != NULL) {
+        pcb->state = PROCESS_RUNNING;
+        last_cpu[pcb->pid] = (int)cpu_id;
+        if(gang_scheduling) {
+            slice = gang_slice(pcb, slice);
+        }
+        if(energy_aware) {
+            simulator_set_cpu_level(cpu_id, io_bound(pcb) ?
+                                    simulator_cpu_levels(cpu_id) - 1 : 0);
+            __atomic_add_fetch(&placements, 1, __ATOMIC_RELAXED);
+            if(simulator_cpu_speed(cpu_id, 0) ==
+               simulator_cpu_speed(energy_aware_cpu(pcb), 0)) {
+                __atomic_add_fetch(&preferred_placements, 1,
+                                   __ATOMIC_RELAXED);
+            }
+        }
+    }
+    __atomic_store_n(&current[cpu_id], pcb, __ATOMIC_RELEASE);
+    context_switch(cpu_id, pcb, slice);
+    if(gang_scheduling && pcb != NULL) {
+        coschedule(pcb->tgid);
+    }
+    return pcb;
+}
+
+/*
+ * lock_run_queue() locks a run queue, counting the acquisitions that had to
+ * wait for another CPU.  With --lock-free the run queues are MPMC queues
+ * and neither it nor unlock_run_queue() does anything.
+ */
+static void lock_run_queue(unsigned int queue_id)
+{
+    run_queue_t *rq = &run_queues[queue_id];
+
+    if(lock_free) {
+        return;
+    }
+    IF_LOCKSTAT(lockstat_wait();)
+    if(pthread_mutex_trylock(&rq->mutex) != 0) {
+        pthread_mutex_lock(&rq->mutex);
+        rq->contended++;
+    }
+    rq->acquired++;
+    IF_LOCKSTAT(lockstat_acquired(&rq->lockstat);)
+}
+
+static void unlock_run_queue(unsigned int queue_id)
+{
+    if(!lock_free) {
+        IF_LOCKSTAT(lockstat_released(&run_queues[queue_id].lockstat);)
+        pthread_mutex_unlock(&run_queues[queue_id].mutex);
+    }
+}
+
+/*
+ * claim_idle_cpu() clears the idle bit of cpu_id and returns nonzero if it
+ * was set, meaning the caller now owes that CPU a wakeup.
+ */
+static int claim_idle_cpu(unsigned int cpu_id)
+{
+    unsigned long bit = 1ul << (cpu_id % MASK_BITS);
+
+    return (__atomic_fetch_and(&idle_mask[cpu_id / MASK_BITS], ~bit,
+                               __ATOMIC_SEQ_CST) & bit) != 0;
+}
+
+/*
+ * kick_idle_cpu() wakes a CPU whose idle bit the caller claimed.
+ */
+static void kick_idle_cpu(unsigned int cpu_id)
+{
+    idle_cpu_t *idle_cpu = &idle_cpus[cpu_id];
+
+    pthread_mutex_lock(&idle_cpu->mutex);
+    idle_cpu->kicked = 1;
+    clock_gettime(CLOCK_MONOTONIC, &idle_cpu->kick_time);
+    pthread_cond_signal(&idle_cpu->wakeup);
+    pthread_mutex_unlock(&idle_cpu->mutex);
+    __atomic_add_fetch(&kicks, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * wake_idle_cpu() wakes one idle CPU, cpu_id if it is idle, or every idle
+ * CPU with --broadcast-wakeup.
+ */
+static void wake_idle_cpu(unsigned int cpu_id)
+{
+    unsigned long mask, bit = 1ul << (cpu_id % MASK_BITS);
+    unsigned int word, target;
+
+    if(broadcast_wakeup) {
+        for(word = 0; word < idle_mask_words; word++) {
+            mask = __atomic_exchange_n(&idle_mask[word], 0, __ATOMIC_SEQ_CST);
+            for(; mask != 0; mask &= mask - 1) {
+                kick_idle_cpu(word * (unsigned int)MASK_BITS +
+                              (unsigned int)__builtin_ctzl(mask));
+            }
+        }
+        return;
+    }
+
+    if((__atomic_load_n(&idle_mask[cpu_id / MASK_BITS], __ATOMIC_SEQ_CST) &
+        bit) && claim_idle_cpu(cpu_id)) {
+        kick_idle_cpu(cpu_id);
+        return;
+    }
+
+    /* Otherwise the lowest idle CPU, retrying if another push claims it */
+    word = 0;
+    while(word < idle_mask_words) {
+        mask = __atomic_load_n(&idle_mask[word], __ATOMIC_SEQ_CST);
+        if(mask == 0) {
+            word++;
+            continue;
+        }
+        target = word * (unsigned int)MASK_BITS +
+                 (unsigned int)__builtin_ctzl(mask);
+        if(claim_idle_cpu(target)) {
+            kick_idle_cpu(target);
+            return;
+        }
+    }
+}
+
+/*
+ * push_to_queue() hands a process to the policy for cpu_id, and wakes an
+ * idle CPU if wake is set.
+ */
+static void push_to_queue(pcb_t *pcb, unsigned int cpu_id, int wake)
+{
+    policy->enqueue(pcb, cpu_id);
+    __atomic_add_fetch(&queued, 1, __ATOMIC_SEQ_CST);
+    if(wake) {
+        wake_idle_cpu(cpu_id);
+    }
+}
+
+/*
+ * run_queue_enqueue() queues a process on the run queue of cpu_id, or on
+ * the shared run queue.  It is the enqueue hook of the built-in policies.
+ */
+static void run_queue_enqueue(pcb_t *pcb, unsigned int cpu_id)
+{
+    unsigned int queue_id = per_cpu_queues ? cpu_id : 0;
+    run_queue_t *rq = &run_queues[queue_id];
+
+    lock_run_queue(queue_id);
+    enqueue_time[pcb->pid] = simulator_current_time();
+    rq_push(rq->queue, pcb);
+    __atomic_store_n(&rq->length, rq_size(rq->queue), __ATOMIC_RELAXED);
+    __atomic_add_fetch(&rq->enqueued, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&queue_of[pcb->pid], queue_id, __ATOMIC_RELAXED);
+    unlock_run_queue(queue_id);
+}
+
+/*
+ * run_queue_pick_next() is the pick_next hook of the built-in policies
+ * that run a process for the default time slice.
+ */
+static pcb_t* run_queue_pick_next(unsigned int cpu_id, int *slice)
+{
+    (void)slice;
+    return pop_from_queue(cpu_id);
+}
+
+/*
+ * pop_from_queue() takes the next process from the run queue of cpu_id,
+ * stealing from another CPU's run queue when that one is empty.
+ */
+static pcb_t* pop_from_queue(unsigned int cpu_id)
+{
+    unsigned int queue_id = per_cpu_queues ? cpu_id : 0;
+    run_queue_t *rq = &run_queues[queue_id];
+    unsigned int n, length, shortest, longest;
+    pcb_t *node;
+
+    lock_run_queue(queue_id);
+    node = take_from_queue(queue_id);
+    if(node != NULL) {
+        __atomic_add_fetch(&rq->dispatched, 1, __ATOMIC_RELAXED);
+    }
+    unlock_run_queue(queue_id);
+
+    if(node == NULL && per_cpu_queues) {
+        node = steal_from_queue(cpu_id);
+    }
+    if(node != NULL) {
+        __atomic_sub_fetch(&queued, 1, __ATOMIC_SEQ_CST);
+    }
+
+    /* Sample the spread between the longest and shortest run queue */
+    if(per_cpu_queues) {
+        shortest = longest = __atomic_load_n(&run_queues[0].length,
+                                             __ATOMIC_RELAXED);
+        for(n = 1; n < run_queue_count; n++) {
+            length = __atomic_load_n(&run_queues[n].length, __ATOMIC_RELAXED);
+            if(length < shortest) shortest = length;
+            if(length > longest) longest = length;
+        }
+        __atomic_add_fetch(&imbalance_sum, longest - shortest,
+                           __ATOMIC_RELAXED);
+        __atomic_add_fetch(&imbalance_samples, 1, __ATOMIC_RELAXED);
+    }
+    return node;
+}
+
+/*
+ * steal_from_queue() takes the next process of the longest run queue.  The
+ * lengths are read without locks, so the victim is re-checked under its
+ * own lock and the search retried if it was emptied in the meantime.
+ */
+static pcb_t* steal_from_queue(unsigned int cpu_id)
+{
+    unsigned int n, victim, length, longest;
+    pcb_t *node;
+
+    while(__atomic_load_n(&queued, __ATOMIC_SEQ_CST) > 0) {
+        victim = cpu_id;
+        longest = 0;
+        for(n = 0; n < run_queue_count; n++) {
+            length = __atomic_load_n(&run_queues[n].length, __ATOMIC_RELAXED);
+            if(n != cpu_id && length > longest) {
+                longest = length;
+                victim = n;
+            }
+        }
+        if(victim == cpu_id) {
+            return NULL;
+        }
+
+        lock_run_queue(victim);
+        node = take_from_queue(victim);
+        unlock_run_queue(victim);
+
+        if(node != NULL) {
+            __atomic_add_fetch(&run_queues[cpu_id].stolen, 1, __ATOMIC_RELAXED);
+            return node;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * take_from_queue() pops the next process of a locked run queue and keeps
+ * its length up to date.
+ */
+static pcb_t* take_from_queue(unsigned int queue_id)
+{
+    run_queue_t *rq = &run_queues[queue_id];
+    pcb_t *node = rq_pop(rq->queue);
+
+    __atomic_store_n(&rq->length, rq_size(rq->queue), __ATOMIC_RELAXED);
+    return node;
+}
+
+/*
+ * check_preempt() preempts the running process that the process that just
+ * woke up should preempt most, if it should preempt it at all.  The
+ * running processes are ranked with the policy's should_preempt, so the
+ * last of them in its order is the one to go, the first one on a tie.  It
+ * leaves the CPUs alone while one of them is idle.
+ */
+static void check_preempt(const pcb_t *process)
+{
+    const pcb_t *cur, *last = NULL;
+    unsigned int i, last_id = 0;
+
+    for(i = 0; i < cpu_count; i++) {
+        cur = running_on(i);
+        if(cur == NULL) {
+            return;
+        }
+        if(last == NULL || policy->should_preempt(last, cur)) {
+            last = cur;
+            last_id = i;
+        }
+    }
+
+    if(last != NULL && policy->should_preempt(process, last)) {
+        force_preempt(last_id);
+    }
+}
+
+/*
+ * create_ordered_queues() gives every run queue a heap or red-black tree
+ * ordered by before(), for count processes.
+ */
+static int create_ordered_queues(ready_queue_t *(*create)(unsigned int,
+                                                          pcb_before_t),
+                                 pcb_before_t before, unsigned int count)
+{
+    unsigned int n;
+
+    for(n = 0; n < run_queue_count; n++) {
+        run_queues[n].queue = create(count - 1, before);
+    }
+    return 0;
+}
+
+/*
+ * FIFO and Round-Robin use FIFO run queues, or MPMC queues with
+ * --lock-free.
+ */
+static int fifo_init(unsigned int cpus, unsigned int count)
+{
+    unsigned int n;
+
+    (void)cpus;
+    for(n = 0; n < run_queue_count; n++) {
+        run_queues[n].queue = lock_free ? rq_create_mpmc(count)
+                                        : rq_create_fifo();
+    }
+    return 0;
+}
+
+/*
+ * LRTF runs the process with the longest remaining time first.  Ties keep
+ * their arrival order.
+ */
+static int lrtf_init(unsigned int cpus, unsigned int count)
+{
+    (void)cpus;
+    return create_ordered_queues(rq_create_heap, longer_remaining_time, count);
+}
+
+static int longer_remaining_time(const pcb_t *a, const pcb_t *b)
+{
+    return a->time_remaining > b->time_remaining;
+}
+
+/*
+ * SRTF runs the process with the shortest remaining time first.
+ */
+static int srtf_init(unsigned int cpus, unsigned int count)
+{
+    (void)cpus;
+    return create_ordered_queues(rq_create_heap, shorter_remaining_time,
+                                 count);
+}
+
+static int shorter_remaining_time(const pcb_t *a, const pcb_t *b)
+{
+    return a->time_remaining < b->time_remaining;
+}
+
+/*
+ * The priority scheduler runs the process with the best effective priority
+ * first, see aging_interval.
+ */
+static int priority_init(unsigned int cpus, unsigned int count)
+{
+    (void)cpus;
+    return create_ordered_queues(rq_create_heap, higher_aged_priority, count);
+}
+
+static int higher_aged_priority(const pcb_t *a, const pcb_t *b)
+{
+    long long x, y;
+
+    x = (long long)a->priority * aging_interval + enqueue_time[a->pid];
+    y = (long long)b->priority * aging_interval + enqueue_time[b->pid];
+    return x < y;
+}
+
+/*
+ * A process that wakes up preempts one with a worse static priority.
+ * Aging only applies while waiting, so it does not protect a running
+ * process.
+ */
+static int higher_priority(const pcb_t *a, const pcb_t *b)
+{
+    return a->priority < b->priority;
+}
+
+/*
+ * deadline_of() returns the absolute deadline of a process, or UINT_MAX if
+ * it is not periodic.
+ */
+static unsigned int deadline_of(const pcb_t *pcb)
+{
+    return pcb->period > 0 ? pcb->deadline : ~0u;
+}
+
+/*
+ * EDF runs the process with the earliest deadline first, and a job that is
+ * released preempts one that is due later.
+ */
+static int edf_init(unsigned int cpus, unsigned int count)
+{
+    (void)cpus;
+    return create_ordered_queues(rq_create_heap, earlier_deadline, count);
+}
+
+static int earlier_deadline(const pcb_t *a, const pcb_t *b)
+{
+    return deadline_of(a) < deadline_of(b);
+}
+
+/*
+ * CFS runs the process with the smallest virtual runtime first.
+ */
+static int cfs_init(unsigned int cpus, unsigned int count)
+{
+    (void)cpus;
+    return create_ordered_queues(rq_create_rbtree, smaller_vruntime, count);
+}
+
+static int smaller_vruntime(const pcb_t *a, const pcb_t *b)
+{
+    return vruntime[a->pid] < vruntime[b->pid];
+}
+
+/* cfs_enqueue() adds the weight of a process to its run queue's load */
+static void cfs_enqueue(pcb_t *pcb, unsigned int cpu_id)
+{
+    unsigned int queue_id = per_cpu_queues ? cpu_id : 0;
+
+    __atomic_add_fetch(&run_queues[queue_id].load, process_weight(pcb),
+                       __ATOMIC_RELAXED);
+    run_queue_enqueue(pcb, cpu_id);
+}
+
+/*
+ * cfs_pick_next() takes the process with the smallest vruntime and gives
+ * it its share of target_latency.  The min_vruntime of the run queue it
+ * came from only moves forward.
+ */
+static pcb_t* cfs_pick_next(unsigned int cpu_id, int *slice)
+{
+    pcb_t *pcb = pop_from_queue(cpu_id);
+    run_queue_t *rq;
+    unsigned long long min;
+
+    if(pcb == NULL) {
+        return NULL;
+    }
+    rq = &run_queues[__atomic_load_n(&queue_of[pcb->pid], __ATOMIC_RELAXED)];
+    __atomic_sub_fetch(&rq->load, process_weight(pcb), __ATOMIC_RELAXED);
+    min = __atomic_load_n(&rq->min_vruntime, __ATOMIC_RELAXED);
+    while(vruntime[pcb->pid] > min &&
+          !__atomic_compare_exchange_n(&rq->min_vruntime, &min,
+                                       vruntime[pcb->pid], 0,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+    *slice = cfs_time_slice(pcb, cpu_id);
+    return pcb;
+}
+
+/*
+ * current_vruntime() returns the vruntime of a process, including the
+ * ticks it has run since it was dispatched.
+ */
+static unsigned long long current_vruntime(const pcb_t *pcb)
+{
+    unsigned long long ran = 0;
+
+    if(pcb->state == PROCESS_RUNNING) {
+        ran = simulator_ticks_run((unsigned int)last_cpu[pcb->pid]);
+    }
+    return vruntime[pcb->pid] +
+           ran * VRUNTIME_SCALE * NICE_0_WEIGHT / process_weight(pcb);
+}
+
+/*
+ * A process that wakes up preempts one whose vruntime is more than
+ * min_granularity ahead of its own.  check_preempt() also ranks the
+ * running processes with it, and between two of those the larger vruntime
+ * simply ranks last.
+ */
+static int cfs_should_preempt(const pcb_t *woken, const pcb_t *running)
+{
+    unsigned long long granularity = 0;
+
+    if(woken->state != PROCESS_RUNNING) {
+        granularity = min_granularity * VRUNTIME_SCALE;
+    }
+    return current_vruntime(running) > current_vruntime(woken) + granularity;
+}
+
+/*
+ * process_weight() maps the nice value of a process to its CFS weight.
+ */
+static unsigned int process_weight(const pcb_t *pcb)
+{
+    int nice = pcb->priority;
+
+    if(nice < -20) nice = -20;
+    if(nice > 19) nice = 19;
+    return nice_to_weight[nice + 20];
+}
+
+/*
+ * account_runtime() charges the ticks a process ran since it was dispatched
+ * to its vruntime.  Ticks lost to switch overhead and cache refills are not
+ * charged, as the process did not run in them.
+ */
+static void account_runtime(pcb_t *pcb, unsigned int cpu_id)
+{
+    unsigned long long ran = simulator_ticks_run(cpu_id);
+
+    vruntime[pcb->pid] += ran * VRUNTIME_SCALE * NICE_0_WEIGHT /
+                          process_weight(pcb);
+}
+
+/*
+ * place_process() sets the vruntime of a process entering a run queue.  A
+ * new process starts at the queue's min_vruntime.  A process waking from
+ * I/O keeps its vruntime, but is credited at most half a target latency
+ * for sleeping, so it cannot hoard CPU time by blocking.
+ */
+static void place_process(pcb_t *pcb, unsigned int cpu_id)
+{
+    unsigned int queue_id = per_cpu_queues ? cpu_id : 0;
+    unsigned long long min, credit;
+
+    min = __atomic_load_n(&run_queues[queue_id].min_vruntime,
+                          __ATOMIC_RELAXED);
+    credit = (unsigned long long)target_latency * VRUNTIME_SCALE / 2;
+
+    if(pcb->state == PROCESS_NEW) {
+        vruntime[pcb->pid] = min;
+    }
+    else if(min > credit && vruntime[pcb->pid] < min - credit) {
+        vruntime[pcb->pid] = min - credit;
+    }
+}
+
+/*
+ * cfs_time_slice() returns the share of target_latency of a process just
+ * taken from the run queue of cpu_id.
+ */
+static int cfs_time_slice(const pcb_t *pcb, unsigned int cpu_id)
+{
+    unsigned int queue_id = per_cpu_queues ? cpu_id : 0;
+    unsigned long weight, load;
+    unsigned long long slice;
+
+    weight = process_weight(pcb);
+    load = __atomic_load_n(&run_queues[queue_id].load, __ATOMIC_RELAXED) +
+           weight;
+    slice = (unsigned long long)target_latency * weight / load;
+    if(slice < min_granularity) {
+        slice = min_granularity;
+    }
+    return (int)slice;
+}
+
+/*
+ * admit_task_set() checks the periodic processes against the EDF
+ * utilization bound and returns 0 if they are admitted.  A burst of c
+ * ticks holds a CPU for c + 1 ticks in the simulator, so that is the
+ * worst-case execution time of a job.
+ */
+static int admit_task_set(void)
+{
+    double utilization = 0.0, largest = 0.0, u, bound;
+    unsigned int n, wcet;
+    const op_t *op;
+
+    for(n = 0; n < process_count; n++) {
+        if(processes[n].period == 0) {
+            continue;
+        }
+        wcet = 0;
+        for(op = processes[n].pc; op->type != OP_TERMINATE; op++) {
+            if(op->type == OP_CPU && op->time + 1 > wcet) {
+                wcet = op->time + 1;
+            }
+        }
+        u = (double)wcet / processes[n].period;
+        utilization += u;
+        if(u > largest) {
+            largest = u;
+        }
+    }
+
+    bound = cpu_count - (cpu_count - 1) * largest;
+    if(utilization > bound) {
+        fprintf(stderr, "Task set rejected: utilization %.2f exceeds the EDF"
+                " bound of %.2f on %u CPUs\n", utilization, bound, cpu_count);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * load_scheduler() loads the policy of a shared object built against
+ * scheduler.h, and returns 0 or -1 if it cannot be used.
+ */
+static int load_scheduler(const char *path)
+{
+    void *handle;
+
+    handle = dlopen(path, RTLD_NOW);
+    if(handle == NULL) {
+        fprintf(stderr, "%s\n", dlerror());
+        return -1;
+    }
+    sched_ops = dlsym(handle, "scheduler_ops");
+    if(sched_ops == NULL) {
+        fprintf(stderr, "%s: no scheduler_ops symbol\n", path);
+        return -1;
+    }
+    if(sched_ops->abi_version != SCHEDULER_ABI_VERSION ||
+       sched_ops->init == NULL || sched_ops->enqueue == NULL ||
+       sched_ops->pick_next == NULL) {
+        fprintf(stderr, "%s: built for scheduler ABI %u, not %u, or missing"
+                " init, enqueue or pick_next\n", path, sched_ops->abi_version,
+                SCHEDULER_ABI_VERSION);
+        sched_ops = NULL;
+        return -1;
+    }
+
+    /* Leave out the wrappers of hooks the policy does not have */
+    plugin_ops.abi_version = SCHEDULER_ABI_VERSION;
+    plugin_ops.name = sched_ops->name;
+    plugin_ops.init = plugin_init;
+    plugin_ops.enqueue = plugin_enqueue;
+    plugin_ops.pick_next = plugin_pick_next;
+    plugin_ops.on_preempt = sched_ops->on_preempt ? plugin_on_preempt : NULL;
+    plugin_ops.on_yield = sched_ops->on_yield ? plugin_on_yield : NULL;
+    plugin_ops.on_wake = sched_ops->on_wake ? plugin_on_wake : NULL;
+    plugin_ops.should_preempt = sched_ops->should_preempt ?
+                                plugin_should_preempt : NULL;
+    return 0;
+}
+
+/*
+ * The hooks of plugin_ops call those of the loaded policy with the lock of
+ * run queue 0 held, and count its enqueues and dispatches there.
+ */
+static int plugin_init(unsigned int cpus, unsigned int count)
+{
+    return sched_ops->init(cpus, count);
+}
+
+static void plugin_enqueue(pcb_t *pcb, unsigned int cpu_id)
+{
+    lock_run_queue(0);
+    sched_ops->enqueue(pcb, cpu_id);
+    __atomic_add_fetch(&run_queues[0].enqueued, 1, __ATOMIC_RELAXED);
+    unlock_run_queue(0);
+}
+
+static pcb_t* plugin_pick_next(unsigned int cpu_id, int *slice)
+{
+    pcb_t *node;
+
+    lock_run_queue(0);
+    node = sched_ops->pick_next(cpu_id, slice);
+    if(node != NULL) {
+        __atomic_add_fetch(&run_queues[0].dispatched, 1, __ATOMIC_RELAXED);
+    }
+    unlock_run_queue(0);
+
+    if(node != NULL) {
+        __atomic_sub_fetch(&queued, 1, __ATOMIC_SEQ_CST);
+    }
+    return node;
+}
+
+static void plugin_on_preempt(pcb_t *pcb, unsigned int cpu_id)
+{
+    lock_run_queue(0);
+    sched_ops->on_preempt(pcb, cpu_id);
+    unlock_run_queue(0);
+}
+
+static void plugin_on_yield(pcb_t *pcb, unsigned int cpu_id)
+{
+    lock_run_queue(0);
+    sched_ops->on_yield(pcb, cpu_id);
+    unlock_run_queue(0);
+}
+
+static void plugin_on_wake(pcb_t *pcb, unsigned int cpu_id)
+{
+    lock_run_queue(0);
+    sched_ops->on_wake(pcb, cpu_id);
+    unlock_run_queue(0);
+}
+
+static int plugin_should_preempt(const pcb_t *woken, const pcb_t *running)
+{
+    int preempt_running;
+
+    lock_run_queue(0);
+    preempt_running = sched_ops->should_preempt(woken, running);
+    unlock_run_queue(0);
+    return preempt_running;
+}
+
+/*
+ * MLFQ uses multilevel run queues, one level per priority.
  */
+static int mlfq_init(unsigned int cpus, unsigned int count)
+{
+    unsigned int n;
+
+    (void)cpus;
+    (void)count;
+    for(n = 0; n < run_queue_count; n++) {
+        run_queues[n].queue = rq_create_multilevel(mlfq_levels, mlfq_level_of);
+    }
+    return 0;
+}
 
-static void schedule(unsigned int cpu_id)
+/*
+ * mlfq_pick_next() boosts every process if it is time, then takes the
+ * first process of the highest level and gives it the quantum of that
+ * level.
+ */
+static pcb_t* mlfq_pick_next(unsigned int cpu_id, int *slice)
 {
+    unsigned int level;
     pcb_t *pcb;
-    pcb = pop_from_queue();
 
+    mlfq_boost();
+    pcb = pop_from_queue(cpu_id);
     if(pcb != NULL) {
-        pcb->state = PROCESS_RUNNING;
+        level = mlfq_level_of(pcb);
+        *slice = (int)(mlfq_quantum << level);
+        mlfq_slice[pcb->pid] = *slice;
+        __atomic_add_fetch(&level_dispatched[level], 1, __ATOMIC_RELAXED);
     }
-    pthread_mutex_lock(&current_mutex);
-    current[cpu_id] = pcb;
-    pthread_mutex_unlock(&current_mutex);
-    context_switch(cpu_id, pcb, time_slice);
+    return pcb;
 }
 
-static void push_to_queue(pcb_t *pcb)
+/*
+ * mlfq_on_preempt() drops a process that used its whole quantum a level.
+ * One that was preempted by a higher level keeps its own.  Ticks the CPU
+ * lost to a switch or a cold cache do not count against the quantum.
+ */
+static void mlfq_on_preempt(pcb_t *pcb, unsigned int cpu_id)
 {
-    pcb_t *curr;
-    pthread_mutex_lock(&ready_mutex);
-    curr = head;
-    if(curr == NULL) {
-        head = pcb;
+    if((int)simulator_ticks_run(cpu_id) >= mlfq_slice[pcb->pid] &&
+       mlfq_level_of(pcb) + 1 < mlfq_levels) {
+        __atomic_add_fetch(&mlfq_level[pcb->pid], 1, __ATOMIC_RELAXED);
     }
-    else {
-        while(curr->next != NULL) {
-           curr = curr->next;
+}
+
+/* A process that wakes up preempts one on a lower level */
+static int higher_level(const pcb_t *a, const pcb_t *b)
+{
+    return mlfq_level_of(a) < mlfq_level_of(b);
+}
+
+/*
+ * mlfq_level_of() returns the MLFQ level a process is queued at.
+ */
+static unsigned int mlfq_level_of(const pcb_t *pcb)
+{
+    return __atomic_load_n(&mlfq_level[pcb->pid], __ATOMIC_RELAXED);
+}
+
+/*
+ * mlfq_boost() moves every process back to the top level once boost_period
+ * ticks have passed since the last boost.  Only the CPU that claims the
+ * boost does it; the queued processes are re-queued in priority order.
+ */
+static void mlfq_boost(void)
+{
+    unsigned int now, last, n, q, count;
+
+    now = simulator_current_time();
+    last = __atomic_load_n(&last_boost, __ATOMIC_RELAXED);
+    if(now - last < boost_period ||
+       !__atomic_compare_exchange_n(&last_boost, &last, now, 0,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        return;
+    }
+
+    boosts++;
+    for(n = 0; n < process_count; n++) {
+        __atomic_store_n(&mlfq_level[n], 0, __ATOMIC_RELAXED);
+    }
+    for(q = 0; q < run_queue_count; q++) {
+        lock_run_queue(q);
+        count = 0;
+        while((boost_buffer[count] = rq_pop(run_queues[q].queue)) != NULL) {
+            count++;
         }
-        curr->next = pcb;
+        for(n = 0; n < count; n++) {
+            rq_push(run_queues[q].queue, boost_buffer[n]);
+        }
+        unlock_run_queue(q);
     }
-    pcb->next = NULL;
-    pthread_cond_broadcast(&not_idle);
-    pthread_mutex_unlock(&ready_mutex);
 }
 
-static pcb_t* pop_from_queue()
+/*
+ * energy_aware_cpu() returns the CPU a process should wake up on: one with
+ * the highest top speed for a CPU-bound process and the lowest for an
+ * I/O-bound one, preferring the CPU it last ran on, then an idle one, then
+ * the one with the shortest run queue.
+ */
+static unsigned int energy_aware_cpu(const pcb_t *process)
 {
-    pcb_t *node;
-    pcb_t *curr;
-    pcb_t *prev;
+    unsigned int n, speed, target = 0, best = 0, load, best_load = 0;
+    int slow = io_bound(process);
 
-    int high = 0;
-    switch (scheduling_alg){
+    for(n = 0; n < cpu_count; n++) {
+        speed = simulator_cpu_speed(n, 0);
+        if(n == 0 || (slow ? speed < target : speed > target)) {
+            target = speed;
+        }
+    }
 
-        // LRTF
-        case 'l':
-            pthread_mutex_lock(&ready_mutex);
-            if(head == NULL) {
-                node = NULL;
-            }
-            else {
-                curr = head;
-                while(curr != NULL) {
-                    if(curr->time_remaining > high) {
-                        high = curr->time_remaining;
-                    }
-                    curr = curr->next;
-                }
-                curr = head;
-                prev = head;
-                while(curr != NULL) {
-                    if(curr->time_remaining == high) {
-                        node = curr;
-                        if(curr==head) {
-                            head = curr->next;
-                        }
-                        else {
-                            prev->next = curr->next;
-                        }
-                        break;
-                    }
-                    prev = curr;
-                    curr = curr->next;
-                }
-            }
-            pthread_mutex_unlock(&ready_mutex);
-            return node;
-            break;
+    if(last_cpu[process->pid] >= 0 &&
+       simulator_cpu_speed((unsigned int)last_cpu[process->pid], 0) ==
+       target) {
+        return (unsigned int)last_cpu[process->pid];
+    }
+
+    best_load = ~0u;
+    for(n = 0; n < cpu_count; n++) {
+        if(simulator_cpu_speed(n, 0) != target) {
+            continue;
+        }
+        load = running_on(n) == NULL ? 0 : 1;
+        if(per_cpu_queues) {
+            load += __atomic_load_n(&run_queues[n].length, __ATOMIC_RELAXED);
+        }
+        if(load < best_load) {
+            best_load = load;
+            best = n;
+        }
+    }
+    return best;
+}
+
+/*
+ * io_bound() returns nonzero if a process has so far spent more time
+ * blocked than running, see energy_aware.
+ */
+static int io_bound(const pcb_t *pcb)
+{
+    return blocked_ticks[pcb->pid] > cpu_ticks[pcb->pid];
+}
+
+/*
+ * gang_slice() returns the time slice of a thread being dispatched under
+ * gang scheduling, and counts it as running.  A stale gang_expiry[], from
+ * before the whole gang was last descheduled, gives a full slice.
+ */
+static int gang_slice(const pcb_t *pcb, int slice)
+{
+    unsigned int now, expiry;
 
-        // FIFO or Round-Robin
-        default:
+    now = simulator_current_time();
+    if(__atomic_fetch_add(&gang_running[pcb->tgid], 1,
+                          __ATOMIC_ACQ_REL) == 0) {
+        if(slice > 0) {
+            __atomic_store_n(&gang_expiry[pcb->tgid], now + (unsigned int)slice,
+                             __ATOMIC_RELAXED);
+        }
+        return slice;
+    }
+    expiry = __atomic_load_n(&gang_expiry[pcb->tgid], __ATOMIC_RELAXED);
+    if(slice > 0 && expiry > now) {
+        slice = (int)(expiry - now);
+    }
+    return slice;
+}
+
+/*
+ * coschedule() hands every ready thread of the process tgid to a CPU of its
+ * own.  A thread that finds no CPU goes back to its run queue.
+ */
+static void coschedule(unsigned int tgid)
+{
+    unsigned int t, queue_id;
+    pcb_t *thread;
+    int removed;
+
+    for(t = tgid; t < process_count && processes[t].tgid == tgid; t++) {
+        thread = &processes[t];
+        if(thread->state != PROCESS_READY) {
+            continue;
+        }
+
+        /* It may have been dispatched or handed out meanwhile */
+        queue_id = __atomic_load_n(&queue_of[t], __ATOMIC_RELAXED);
+        lock_run_queue(queue_id);
+        removed = rq_remove(run_queues[queue_id].queue, thread);
+        __atomic_store_n(&run_queues[queue_id].length,
+                         rq_size(run_queues[queue_id].queue), __ATOMIC_RELAXED);
+        unlock_run_queue(queue_id);
+        if(!removed) {
+            continue;
+        }
+        __atomic_sub_fetch(&queued, 1, __ATOMIC_SEQ_CST);
+
+        if(!place_thread(thread, tgid)) {
+            __atomic_add_fetch(&gang_unplaced, 1, __ATOMIC_RELAXED);
+            push_to_queue(thread, queue_id, 0);
+        }
+    }
+}
 
-            pthread_mutex_lock(&ready_mutex);
-            node = head;
-            if(node != NULL) {
-                head = node->next;
+/*
+ * place_thread() hands a thread of the process tgid to an idle CPU, or to
+ * a CPU running another process, which it preempts.  Returns 0 if every
+ * CPU runs the process already or has a thread handed to it.
+ */
+static int place_thread(pcb_t *thread, unsigned int tgid)
+{
+    unsigned int n;
+    pcb_t *expected;
+    const pcb_t *cur;
+
+    for(n = 0; n < cpu_count; n++) {
+        expected = NULL;
+        if(running_on(n) == NULL &&
+           __atomic_compare_exchange_n(&gang_slot[n], &expected, thread, 0,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            if(!simulator_virtual_time() && claim_idle_cpu(n)) {
+                kick_idle_cpu(n);
             }
-            pthread_mutex_unlock(&ready_mutex);
-            return node;
+            __atomic_add_fetch(&gang_coscheduled, 1, __ATOMIC_RELAXED);
+            return 1;
+        }
+    }
+
+    for(n = 0; n < cpu_count; n++) {
+        expected = NULL;
+        cur = running_on(n);
+        if(cur != NULL && cur->tgid != tgid &&
+           __atomic_compare_exchange_n(&gang_slot[n], &expected, thread, 0,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            force_preempt(n);
+            __atomic_add_fetch(&gang_coscheduled, 1, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&gang_displaced, 1, __ATOMIC_RELAXED);
+            return 1;
+        }
     }
+    return 0;
+}
+
+/* gang_pending() returns nonzero if a thread was handed to cpu_id */
+static int gang_pending(unsigned int cpu_id)
+{
+    return gang_scheduling &&
+           __atomic_load_n(&gang_slot[cpu_id], __ATOMIC_ACQUIRE) != NULL;
 }
 
 /*
@@ -160,16 +1269,83 @@ static pcb_t* pop_from_queue()
  */
 extern void idle(unsigned int cpu_id)
 {
-    pthread_mutex_lock(&ready_mutex);
+    idle_cpu_t *idle_cpu = &idle_cpus[cpu_id];
+    unsigned long bit = 1ul << (cpu_id % MASK_BITS);
+    int slept = 0;
 
-    while(head==NULL){
-        pthread_cond_wait(&not_idle,&ready_mutex);
+    /* In virtual time the simulator calls idle() again on wake_up() */
+    if(simulator_virtual_time()) {
+        if(__atomic_load_n(&queued, __ATOMIC_SEQ_CST) > 0 ||
+           gang_pending(cpu_id)) {
+            schedule(cpu_id);
+        }
+        return;
     }
 
-    pthread_mutex_unlock(&ready_mutex);
-    schedule(cpu_id);
+    pthread_mutex_lock(&idle_cpu->mutex);
+    __atomic_or_fetch(&idle_mask[cpu_id / MASK_BITS], bit, __ATOMIC_SEQ_CST);
+
+    while(__atomic_load_n(&queued, __ATOMIC_SEQ_CST) == 0 &&
+          !gang_pending(cpu_id)) {
+        if(idle_cpu->kicked && !broadcast_wakeup) {
+            break;
+        }
+        /* Like the old broadcast loop, a CPU woken for work another CPU
+         * already took goes back to sleep without a context switch */
+        if(idle_cpu->kicked) {
+            if(slept) {
+                account_wakeup(idle_cpu);
+                __atomic_add_fetch(&futile_wakeups, 1, __ATOMIC_RELAXED);
+            }
+            idle_cpu->kicked = 0;
+            slept = 0;
+            __atomic_or_fetch(&idle_mask[cpu_id / MASK_BITS], bit,
+                              __ATOMIC_SEQ_CST);
+            continue;
+        }
+        pthread_cond_wait(&idle_cpu->wakeup, &idle_cpu->mutex);
+        slept = 1;
+    }
+
+    if(slept) {
+        account_wakeup(idle_cpu);
+    }
+    idle_cpu->kicked = 0;
+    pthread_mutex_unlock(&idle_cpu->mutex);
+    claim_idle_cpu(cpu_id);
+
+    /* A wakeup is futile when another CPU already took the work */
+    if(schedule(cpu_id) == NULL && slept) {
+        __atomic_add_fetch(&futile_wakeups, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/*
+ * account_wakeup() counts a wakeup of an idle CPU and, if it was kicked,
+ * its latency from the kick.  Must be called with the mutex of the idle
+ * CPU held.
+ */
+static void account_wakeup(idle_cpu_t *idle_cpu)
+{
+    struct timespec now;
+    unsigned long long latency;
+
+    __atomic_add_fetch(&wakeups, 1, __ATOMIC_RELAXED);
+    if(!idle_cpu->kicked) {
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    latency = (unsigned long long)((now.tv_sec -
+                                    idle_cpu->kick_time.tv_sec) *
+                                   1000000000L + now.tv_nsec -
+                                   idle_cpu->kick_time.tv_nsec);
+    __atomic_add_fetch(&wakeup_latency_sum, latency, __ATOMIC_RELAXED);
+    if(latency > __atomic_load_n(&wakeup_latency_max, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&wakeup_latency_max, latency, __ATOMIC_RELAXED);
+    }
 }
 
+
 /*
  * preempt() is the handler called by the simulator when a process is
  * preempted due to its timeslice expiring.
@@ -180,11 +1356,19 @@ extern void idle(unsigned int cpu_id)
 extern void preempt(unsigned int cpu_id)
 {
     pcb_t* pcb;
-    pthread_mutex_lock(&current_mutex);
-    pcb = current[cpu_id];
+    pcb = running_on(cpu_id);
     pcb->state = PROCESS_READY;
-    pthread_mutex_unlock(&current_mutex);
-    push_to_queue(pcb);
+    if(gang_scheduling) {
+        __atomic_sub_fetch(&gang_running[pcb->tgid], 1, __ATOMIC_ACQ_REL);
+    }
+    cpu_ticks[pcb->pid] += simulator_ticks_run(cpu_id);
+    if(policy->on_preempt != NULL) {
+        policy->on_preempt(pcb, cpu_id);
+    }
+    /* This CPU schedules right away and takes a process off the queue, so
+     * waking an idle CPU would be futile.  The broadcast baseline still
+     * does, as the old code did. */
+    push_to_queue(pcb, cpu_id, broadcast_wakeup);
     schedule(cpu_id);
 }
 
@@ -199,10 +1383,16 @@ extern void preempt(unsigned int cpu_id)
 extern void yield(unsigned int cpu_id)
 {
     pcb_t *pcb;
-    pthread_mutex_lock(&current_mutex);
-    pcb = current[cpu_id];
+    pcb = running_on(cpu_id);
     pcb->state = PROCESS_WAITING;
-    pthread_mutex_unlock(&current_mutex);
+    if(gang_scheduling) {
+        __atomic_sub_fetch(&gang_running[pcb->tgid], 1, __ATOMIC_ACQ_REL);
+    }
+    cpu_ticks[pcb->pid] += simulator_ticks_run(cpu_id);
+    blocked_since[pcb->pid] = simulator_current_time();
+    if(policy->on_yield != NULL) {
+        policy->on_yield(pcb, cpu_id);
+    }
     schedule(cpu_id);
 }
 
@@ -215,10 +1405,11 @@ extern void yield(unsigned int cpu_id)
 extern void terminate(unsigned int cpu_id)
 {
     pcb_t *pcb;
-    pthread_mutex_lock(&current_mutex);
-    pcb = current[cpu_id];
+    pcb = running_on(cpu_id);
     pcb->state = PROCESS_TERMINATED;
-    pthread_mutex_unlock(&current_mutex);
+    if(gang_scheduling) {
+        __atomic_sub_fetch(&gang_running[pcb->tgid], 1, __ATOMIC_ACQ_REL);
+    }
     schedule(cpu_id);
 }
 
@@ -241,74 +1432,510 @@ extern void terminate(unsigned int cpu_id)
  */
 extern void wake_up(pcb_t *process)
 {
-    int low;
-    int low_id;
+    unsigned int n, cpu_id;
 
-    process->state = PROCESS_READY;
-    push_to_queue(process);
+    if(process->state == PROCESS_WAITING) {
+        blocked_ticks[process->pid] += simulator_current_time() -
+                                       blocked_since[process->pid];
+    }
 
-    if(scheduling_alg == 'l') {
-        pthread_mutex_lock(&current_mutex);
-        low_id = -1;
-        low = 10;
-        for(int i = 0; i < cpu_count; i++) {
-                if(current[i] == NULL) {
-                    low_id = -1;
-                    break;
-                }
-                if(current[i]->time_remaining < low) {
-                    low = current[i]->time_remaining;
-                    low_id = i;
-                }
+    /*
+     * Wake up on the CPU the process last ran on, so it finds its cache
+     * warm.  A new process goes to the shortest run queue.
+     */
+    cpu_id = 0;
+    if(energy_aware) {
+        cpu_id = energy_aware_cpu(process);
+    }
+    else if(last_cpu[process->pid] >= 0) {
+        cpu_id = (unsigned int)last_cpu[process->pid];
+    }
+    else {
+        for(n = 1; n < run_queue_count; n++) {
+            if(__atomic_load_n(&run_queues[n].length, __ATOMIC_RELAXED) <
+               __atomic_load_n(&run_queues[cpu_id].length, __ATOMIC_RELAXED)) {
+                cpu_id = n;
+            }
         }
-        pthread_mutex_unlock(&current_mutex);
-        if(low_id != -1 && low < process->time_remaining) {
-            force_preempt(low_id);
+    }
+
+    if(policy->on_wake != NULL) {
+        policy->on_wake(process, cpu_id);
+    }
+    process->state = PROCESS_READY;
+    push_to_queue(process, cpu_id, 1);
+
+    if(policy->should_preempt != NULL) {
+        check_preempt(process);
+    }
+
+    /* A thread of a running gang joins it at once */
+    if(gang_scheduling &&
+       __atomic_load_n(&gang_running[process->tgid], __ATOMIC_ACQUIRE) > 0) {
+        coschedule(process->tgid);
+    }
+}
+
+/*
+ * print_scheduler_stats() is called by the simulator after its final
+ * statistics.  It reports run queue lock contention and idle CPU wakeups
+ * with --sched-stats and, with per-CPU run queues, how evenly the work was
+ * spread.
+ */
+extern void print_scheduler_stats(void)
+{
+    unsigned long acquired = 0, contended = 0;
+    unsigned int n;
+
+    if(sched_ops != NULL) {
+        printf("Scheduler: %s\n", sched_ops->name);
+    }
+
+    for(n = 0; n < run_queue_count; n++) {
+        acquired += run_queues[n].acquired;
+        contended += run_queues[n].contended;
+    }
+    if(sched_stats && lock_free) {
+        printf("Run queues are lock-free\n");
+    }
+    else if(sched_stats) {
+        printf("Run queue locks contended: %lu of %lu acquisitions\n",
+               contended, acquired);
+    }
+    if(sched_stats && !simulator_virtual_time()) {
+        printf("Idle CPU wakeups: %lu of %lu futile, %lu sent,"
+               " mean latency %.1f us, max %.1f us\n",
+               futile_wakeups, wakeups, kicks,
+               wakeups ? (double)wakeup_latency_sum / (double)wakeups / 1000.0
+                       : 0.0,
+               (double)wakeup_latency_max / 1000.0);
+    }
+
+    if(energy_aware) {
+        printf("Dispatches on a preferred core: %lu of %lu\n",
+               preferred_placements, placements);
+    }
+    if(gang_scheduling) {
+        printf("Gang threads co-scheduled: %lu, %lu by preempting another"
+               " process, %lu left queued\n", gang_coscheduled,
+               gang_displaced, gang_unplaced);
+    }
+
+    if(scheduling_alg == 'm') {
+        printf("\nLevel  Quantum  Dispatched\n");
+        for(n = 0; n < mlfq_levels; n++) {
+            printf("%-6u %-8u %lu\n", n, mlfq_quantum << n,
+                   level_dispatched[n]);
         }
+        printf("Priority boosts: %lu\n", boosts);
+    }
+
+    if(!per_cpu_queues) {
+        return;
+    }
+
+    printf("\nCPU  Enqueued  Dispatched  Stolen\n");
+    for(n = 0; n < run_queue_count; n++) {
+        printf("%-4u %-9lu %-11lu %lu\n", n, run_queues[n].enqueued,
+               run_queues[n].dispatched, run_queues[n].stolen);
     }
+    printf("Average run queue imbalance: %.2f processes\n",
+           imbalance_samples ? (double)imbalance_sum /
+                               (double)imbalance_samples : 0.0);
 }
 
+/*
+ * The built-in policies.  Round-Robin is FIFO with a time slice.
+ */
+static const scheduler_ops_t fifo_ops = {
+    SCHEDULER_ABI_VERSION,
+    "FIFO",
+    fifo_init,
+    run_queue_enqueue,
+    run_queue_pick_next,
+    NULL,
+    NULL,
+    NULL,
+    NULL
+};
+
+static const scheduler_ops_t lrtf_ops = {
+    SCHEDULER_ABI_VERSION,
+    "LRTF",
+    lrtf_init,
+    run_queue_enqueue,
+    run_queue_pick_next,
+    NULL,
+    NULL,
+    NULL,
+    longer_remaining_time
+};
+
+static const scheduler_ops_t srtf_ops = {
+    SCHEDULER_ABI_VERSION,
+    "SRTF",
+    srtf_init,
+    run_queue_enqueue,
+    run_queue_pick_next,
+    NULL,
+    NULL,
+    NULL,
+    shorter_remaining_time
+};
+
+static const scheduler_ops_t priority_ops = {
+    SCHEDULER_ABI_VERSION,
+    "priority",
+    priority_init,
+    run_queue_enqueue,
+    run_queue_pick_next,
+    NULL,
+    NULL,
+    NULL,
+    higher_priority
+};
+
+static const scheduler_ops_t edf_ops = {
+    SCHEDULER_ABI_VERSION,
+    "EDF",
+    edf_init,
+    run_queue_enqueue,
+    run_queue_pick_next,
+    NULL,
+    NULL,
+    NULL,
+    earlier_deadline
+};
+
+static const scheduler_ops_t cfs_ops = {
+    SCHEDULER_ABI_VERSION,
+    "CFS",
+    cfs_init,
+    cfs_enqueue,
+    cfs_pick_next,
+    account_runtime,
+    account_runtime,
+    place_process,
+    cfs_should_preempt
+};
+
+static const scheduler_ops_t mlfq_ops = {
+    SCHEDULER_ABI_VERSION,
+    "MLFQ",
+    mlfq_init,
+    run_queue_enqueue,
+    mlfq_pick_next,
+    mlfq_on_preempt,
+    NULL,
+    NULL,
+    higher_level
+};
+
 /*
  * main() simply parses command line arguments, then calls start_simulator().
  * You will need to modify it to support the -l and -r command-line parameters.
  */
 int main(int argc, char *argv[])
 {
-    if (argc < 1 || argc > 4)
-    {
-        fprintf(stderr, "ECE 3056 OS Sim -- Multithreaded OS Simulator\n"
-            "Usage: ./os-sim <# CPUs> [ -l | -r <time slice> ]\n"
+    const char *usage =
+            "ECE 3056 OS Sim -- Multithreaded OS Simulator\n"
+            "Usage: ./os-sim <# CPUs>"
+            " [ -l | -r <time slice> | -c <target latency> |"
+            " -m <levels> [ -q <quantum> ] [ -b <boost period> ] | -s |"
+            " -a <aging interval> | -e [ --no-admission ] |"
+            " --sched <policy.so> ] [ -g ] [ -p ]"
+            " [ -n <# processes> | -w <workload> ] [ --latency ]"
+            " [ --json <file> ] [ --io <devices> ] [ --lock-free ]"
+            " [ --broadcast-wakeup ]"
+            " [ --sched-stats ]"
+            " [ --switch-cost <ticks> ] [ --cache-penalty <ticks>[,<K>] ]"
+            " [ --cores <spec> [ --energy-aware ] ]"
+            " [ --record <file> | --replay <file> ] [ --fast ]"
+            " [ --no-gantt ]\n"
+            "       ./os-sim --diff <recording> <recording>\n"
             "    Default : FIFO Scheduler\n"
 	        "         -l : Longest Remaining Time First Scheduler\n"
-            "         -r : Round-Robin Scheduler\n\n");
+            "         -r : Round-Robin Scheduler\n"
+            "         -c : Completely Fair Scheduler, nice values from the"
+            " workload\n"
+            "         -m : Multi-Level Feedback Queue Scheduler\n"
+            "         -q : MLFQ top level quantum, doubled per level"
+            " (default 2)\n"
+            "         -b : MLFQ priority boost period (default 50)\n"
+            "         -s : Shortest Remaining Time First Scheduler\n"
+            "         -a : Priority Scheduler, waiting processes gain a"
+            " level per interval\n"
+            "         -e : Earliest Deadline First Scheduler for periodic"
+            " processes\n"
+            " --no-admission : Run EDF task sets above the utilization"
+            " bound\n"
+            "    --sched : Load the policy from a shared object, with -r as"
+            " its default time slice.  All CPUs share one lock for it, so it"
+            " cannot be used with -p, -g or --lock-free\n"
+            "         -g : Gang scheduling of the threads of a process"
+            " (FIFO and Round-Robin)\n"
+            "         -p : Per-CPU run queues with work stealing\n"
+            "         -n : Number of processes (default 8)\n"
+            "         -w : Load the processes from a workload file.  The"
+            " latency report groups processes into classes by the first"
+            " letter of their name\n"
+            "  --latency : Also report response, turnaround and waiting"
+            " time percentiles\n"
+            "     --json : Also write the statistics to a JSON file\n"
+            "     --fast : Virtual time, no waiting on the wall clock\n"
+            " --no-gantt : Print only the final statistics, not the Gantt"
+            " chart\n"
+            "       --io : I/O devices, e.g. fifo,sstf,parallel:4"
+            " (default fifo)\n"
+            " --lock-free : Experimental lock-free run queues (FIFO and"
+            " Round-Robin), not yet shown to scale better than the locks\n"
+            " --broadcast-wakeup : Wake every idle CPU on each enqueue\n"
+            " --sched-stats : Also report run queue lock contention"
+            " and idle CPU wakeups\n"
+            " --switch-cost : CPU ticks lost on every context switch\n"
+            " --cache-penalty : Extra ticks lost when the cache is cold, after"
+            " a migration or K other processes (default 1)\n"
+            "    --cores : CPU speeds and DVFS levels,"
+            " e.g. 2x200:40/100:12,2x100:8/50:3\n"
+            " --energy-aware : CPU-bound processes on fast cores, I/O-bound"
+            " ones, blocked longer than they ran so far, on slow cores at low"
+            " frequency\n"
+            "   --record : Log every scheduling decision to a file\n"
+            "   --replay : Repeat the decisions of a recording, in virtual"
+            " time\n"
+            "     --diff : Show where two recordings diverge\n\n";
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "%s", usage);
         return -1;
     }
+    if (argc == 4 && strcmp(argv[1], "--diff") == 0)
+        return simulator_compare_recordings(argv[2], argv[3]);
 
-    unsigned int cpu_count;
-    cpu_count = strtoul(argv[1], NULL, 0);
+    unsigned int processes_wanted = DEFAULT_PROCESS_COUNT;
+    const char *workload = NULL;
+    cpu_count = (unsigned int)strtoul(argv[1], NULL, 0);
     time_slice = -1;
+    scheduling_alg = 'f';
 
-    for(int i = 0; i < argc; i++) {
+    for(int i = 2; i < argc; i++) {
 
-        if(strcmp(argv[i],"-r") == 0){
+        if(strcmp(argv[i],"-r") == 0 && i + 1 < argc){
             scheduling_alg = 'r';
-            time_slice = atoi(argv[i + 1]);
+            time_slice = atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i],"-c") == 0 && i + 1 < argc){
+            scheduling_alg = 'c';
+            target_latency = (unsigned int)strtoul(argv[++i], NULL, 0);
+        }
+        else if(strcmp(argv[i],"-m") == 0 && i + 1 < argc){
+            scheduling_alg = 'm';
+            mlfq_levels = (unsigned int)strtoul(argv[++i], NULL, 0);
+        }
+        else if(strcmp(argv[i],"-q") == 0 && i + 1 < argc){
+            mlfq_quantum = (unsigned int)strtoul(argv[++i], NULL, 0);
+        }
+        else if(strcmp(argv[i],"-b") == 0 && i + 1 < argc){
+            boost_period = (unsigned int)strtoul(argv[++i], NULL, 0);
+        }
+        else if(strcmp(argv[i],"-s") == 0){
+            scheduling_alg = 's';
+        }
+        else if(strcmp(argv[i],"-a") == 0 && i + 1 < argc){
+            scheduling_alg = 'a';
+            aging_interval = (unsigned int)strtoul(argv[++i], NULL, 0);
+        }
+        else if(strcmp(argv[i],"-e") == 0){
+            scheduling_alg = 'e';
+        }
+        else if(strcmp(argv[i],"--no-admission") == 0){
+            admission_control = 0;
         }
         else if(strcmp(argv[i],"-l") == 0){
             scheduling_alg = 'l';
         }
+        else if(strcmp(argv[i],"-n") == 0 && i + 1 < argc){
+            processes_wanted = (unsigned int)strtoul(argv[++i], NULL, 0);
+        }
+        else if(strcmp(argv[i],"-w") == 0 && i + 1 < argc){
+            workload = argv[++i];
+        }
+        else if(strcmp(argv[i],"--sched") == 0 && i + 1 < argc){
+            if(load_scheduler(argv[++i]) != 0) {
+                return -1;
+            }
+        }
+        else if(strcmp(argv[i],"-g") == 0){
+            gang_scheduling = 1;
+        }
+        else if(strcmp(argv[i],"-p") == 0){
+            per_cpu_queues = 1;
+        }
+        else if(strcmp(argv[i],"--latency") == 0){
+            simulator_enable_latency_report();
+        }
+        else if(strcmp(argv[i],"--json") == 0 && i + 1 < argc){
+            simulator_enable_json_report(argv[++i]);
+        }
+        else if(strcmp(argv[i],"--io") == 0 && i + 1 < argc){
+            if(simulator_set_io_devices(argv[++i]) != 0) {
+                return -1;
+            }
+        }
+        else if(strcmp(argv[i],"--lock-free") == 0){
+            lock_free = 1;
+        }
+        else if(strcmp(argv[i],"--broadcast-wakeup") == 0){
+            broadcast_wakeup = 1;
+        }
+        else if(strcmp(argv[i],"--sched-stats") == 0){
+            sched_stats = 1;
+        }
+        else if(strcmp(argv[i],"--switch-cost") == 0 && i + 1 < argc){
+            simulator_set_switch_cost(
+                    (unsigned int)strtoul(argv[++i], NULL, 0));
+        }
+        else if(strcmp(argv[i],"--cache-penalty") == 0 && i + 1 < argc){
+            char *end;
+            unsigned int penalty = (unsigned int)strtoul(argv[++i], &end, 0);
+            unsigned int depth = 1;
+
+            if(*end == ',') {
+                depth = (unsigned int)strtoul(end + 1, &end, 0);
+            }
+            if(*end != '\0' || depth < 1) {
+                fprintf(stderr, "%s", usage);
+                return -1;
+            }
+            simulator_set_cache_penalty(penalty, depth);
+        }
+        else if(strcmp(argv[i],"--cores") == 0 && i + 1 < argc){
+            if(simulator_set_cores(argv[++i]) != 0) {
+                return -1;
+            }
+        }
+        else if(strcmp(argv[i],"--energy-aware") == 0){
+            energy_aware = 1;
+        }
+        else if(strcmp(argv[i],"--record") == 0 && i + 1 < argc){
+            if(simulator_record(argv[++i]) != 0) {
+                return -1;
+            }
+        }
+        else if(strcmp(argv[i],"--replay") == 0 && i + 1 < argc){
+            if(simulator_replay(argv[++i]) != 0) {
+                return -1;
+            }
+        }
+        else if(strcmp(argv[i],"--fast") == 0){
+            simulator_enable_virtual_time();
+        }
+        else if(strcmp(argv[i],"--no-gantt") == 0){
+            simulator_disable_gantt_chart();
+        }
         else {
-            scheduling_alg = 'f';
+            fprintf(stderr, "%s", usage);
+            return -1;
         }
     }
 
-    current = malloc(sizeof(pcb_t*) * cpu_count);
+    if (processes_wanted < 1 || (scheduling_alg == 'c' && target_latency < 1) ||
+        (scheduling_alg == 'm' && (mlfq_levels < 1 || mlfq_levels > 16 ||
+                                   mlfq_quantum < 1 || boost_period < 1)) ||
+        (scheduling_alg == 'a' && aging_interval < 1) ||
+        ((lock_free || gang_scheduling) &&
+         scheduling_alg != 'f' && scheduling_alg != 'r') ||
+        (lock_free && gang_scheduling) ||
+        (sched_ops != NULL &&
+         ((scheduling_alg != 'f' && scheduling_alg != 'r') ||
+          per_cpu_queues || lock_free || gang_scheduling)))
+    {
+        fprintf(stderr, "%s", usage);
+        return -1;
+    }
+    if (workload != NULL)
+    {
+        if (load_processes(workload) != 0)
+            return -1;
+    }
+    else
+    {
+        create_processes(processes_wanted);
+    }
+    if (scheduling_alg == 'e' && admission_control && admit_task_set() != 0)
+        return -1;
+
+    current = calloc(cpu_count, sizeof(pcb_t*));
     assert(current != NULL);
-    pthread_mutex_init(&current_mutex, NULL);
 
-    head = NULL;
-    pthread_mutex_init(&ready_mutex, NULL);
-    pthread_cond_init(&not_idle, NULL);
+    last_cpu = malloc(sizeof(int) * process_count);
+    assert(last_cpu != NULL);
+    for(unsigned int i = 0; i < process_count; i++) {
+        last_cpu[i] = -1;
+    }
+
+    vruntime = calloc(process_count, sizeof(unsigned long long));
+    enqueue_time = calloc(process_count, sizeof(unsigned int));
+    assert(vruntime != NULL && enqueue_time != NULL);
+
+    cpu_ticks = calloc(process_count, sizeof(unsigned long long));
+    blocked_ticks = calloc(process_count, sizeof(unsigned long long));
+    blocked_since = calloc(process_count, sizeof(unsigned int));
+    assert(cpu_ticks != NULL && blocked_ticks != NULL &&
+           blocked_since != NULL);
+
+    mlfq_level = calloc(process_count, sizeof(unsigned int));
+    mlfq_slice = calloc(process_count, sizeof(int));
+    boost_buffer = malloc(sizeof(pcb_t*) * (process_count + 1));
+    level_dispatched = calloc(mlfq_levels, sizeof(unsigned long));
+    assert(mlfq_level != NULL && mlfq_slice != NULL && boost_buffer != NULL);
+
+    /* The policy creates the run queues, see its init hook */
+    run_queue_count = per_cpu_queues ? cpu_count : 1;
+    run_queues = calloc(run_queue_count, sizeof(run_queue_t));
+    assert(run_queues != NULL);
+    for(unsigned int i = 0; i < run_queue_count; i++) {
+        pthread_mutex_init(&run_queues[i].mutex, NULL);
+        if(!lock_free) {
+            IF_LOCKSTAT(lockstat_register(&run_queues[i].lockstat, "run queue",
+                                       (int)i);)
+        }
+    }
+
+    switch(scheduling_alg) {
+    case 'l': policy = &lrtf_ops; break;
+    case 's': policy = &srtf_ops; break;
+    case 'a': policy = &priority_ops; break;
+    case 'e': policy = &edf_ops; break;
+    case 'c': policy = &cfs_ops; break;
+    case 'm': policy = &mlfq_ops; break;
+    default: policy = &fifo_ops; break;
+    }
+    if(sched_ops != NULL) {
+        policy = &plugin_ops;
+    }
+    if(policy->init(cpu_count, process_count) != 0) {
+        fprintf(stderr, "Scheduler %s failed to initialize\n", policy->name);
+        return -1;
+    }
+
+    gang_slot = calloc(cpu_count, sizeof(pcb_t*));
+    gang_running = calloc(process_count, sizeof(unsigned int));
+    gang_expiry = calloc(process_count, sizeof(unsigned int));
+    queue_of = calloc(process_count, sizeof(unsigned int));
+    assert(gang_slot != NULL && gang_running != NULL &&
+           gang_expiry != NULL && queue_of != NULL);
+
+    idle_cpus = calloc(cpu_count, sizeof(idle_cpu_t));
+    idle_mask_words = (cpu_count + (unsigned int)MASK_BITS - 1) /
+                      (unsigned int)MASK_BITS;
+    idle_mask = calloc(idle_mask_words, sizeof(unsigned long));
+    assert(idle_cpus != NULL && idle_mask != NULL);
+    for(unsigned int i = 0; i < cpu_count; i++) {
+        pthread_mutex_init(&idle_cpus[i].mutex, NULL);
+        pthread_cond_init(&idle_cpus[i].wakeup, NULL);
+    }
 
     start_simulator(cpu_count);
     return 0;
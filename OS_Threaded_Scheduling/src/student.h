@@ -18,4 +18,7 @@ extern void yield(unsigned int cpu_id);
 extern void terminate(unsigned int cpu_id);
 extern void wake_up(pcb_t *process);
 
+/* Called once at exit, after the simulator's own statistics */
+extern void print_scheduler_stats(void);
+
 #endif /* __STUDENT_H__ */
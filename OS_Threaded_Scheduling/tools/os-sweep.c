@@ -0,0 +1,623 @@
+/*
+ * os-sweep.c
+ * Parameter sweep driver for os-sim
+ *
+ * Runs os-sim once for every combination of CPU count, policy, time slice
+ * and workload, several simulations at a time, and writes one CSV row per
+ * run.  Every run is a separate os-sim process in virtual time (--fast)
+ * whose JSON report is read back, so the simulations share no state and
+ * the rows do not depend on the order the runs finish in.
+ *
+ * The processes stand in for a reentrant simulation context.  The state of
+ * the simulator and of the policies lives in globals throughout os-sim.c
+ * and student.c, and the CPU threads reach it without being passed a
+ * context, so one simulation per process is the unit of isolation for
+ * now.  Moving that state into a context that every function takes would
+ * let the sweep run in-process, but would touch every function of both.
+ *
+ * The slice is the -r time slice for rr, the -c target latency for cfs,
+ * the -q top level quantum for mlfq and the -a aging interval for
+ * priority.  The other policies do not take one and run once per CPU count
+ * and workload, with an empty slice column.  Arguments after -- are passed
+ * to every run, e.g. -- --switch-cost 1.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define MAX_ARGS 64
+
+/*
+ * The os-sim options that select each policy, and the option that takes
+ * the slice or NULL.  MLFQ keeps its default of three levels.
+ */
+typedef struct {
+    const char *name;
+    const char *options[2];
+    const char *slice_option;
+} policy_t;
+
+static const policy_t policies[] = {
+    { "fifo", { NULL, NULL }, NULL },
+    { "rr", { NULL, NULL }, "-r" },
+    { "lrtf", { "-l", NULL }, NULL },
+    { "cfs", { NULL, NULL }, "-c" },
+    { "mlfq", { "-m", "3" }, "-q" },
+    { "srtf", { "-s", NULL }, NULL },
+    { "priority", { NULL, NULL }, "-a" },
+    { "edf", { "-e", NULL }, NULL }
+};
+
+/* The percentiles of the "all" class, in CSV column order */
+static const char *const metrics[] = { "response", "turnaround", "waiting" };
+static const char *const percentiles[] = { "p50", "p95", "p99" };
+
+#define METRIC_COUNT (sizeof(metrics) / sizeof(metrics[0]))
+#define PERCENTILE_COUNT (sizeof(percentiles) / sizeof(percentiles[0]))
+
+typedef struct {
+    unsigned int cpus;
+    const policy_t *policy;
+    unsigned int slice;
+    const char *workload;
+
+    int ok;
+    unsigned long context_switches;
+    double execution_time;
+    double ready_time;
+    double times[METRIC_COUNT][PERCENTILE_COUNT];
+} run_t;
+
+static const char *simulator = "./os-sim";
+static char **extra_args;
+static int extra_count;
+
+static run_t *runs;
+static unsigned int run_count;
+static unsigned int next_run;
+
+extern char **environ;
+
+static void usage(const char *prog);
+static unsigned int split(char *list, char ***items);
+static const policy_t *find_policy(const char *name);
+static const char *json_space(const char *text);
+static const char *json_string(const char *text, char *buf, size_t size);
+static const char *json_skip(const char *text);
+static const char *json_member(const char *text, const char *key);
+static int json_number(const char *text, const char *key, double *value);
+static const char *find_class(const char *report, const char *name);
+static int parse_report(run_t *run, const char *text);
+static char *read_file(const char *path);
+static void simulate(run_t *run);
+static void *sweep_thread(void *data);
+static void print_csv(FILE *out);
+
+
+static void usage(const char *prog)
+{
+    unsigned int n;
+
+    fprintf(stderr, "Usage: %s [options] [-- <os-sim options>]\n"
+            "         -c : CPU counts (default 1,2,4)\n"
+            "         -p : Policies (default fifo,rr), any of",
+            prog);
+    for (n=0; n<sizeof(policies) / sizeof(policies[0]); n++)
+        fprintf(stderr, " %s", policies[n].name);
+    fprintf(stderr, "\n"
+            "         -r : Time slices (default 2,4,6,8)\n"
+            "         -w : Workload files, or builtin (default builtin)\n"
+            "         -j : Simulations run at a time (default one per"
+            " online CPU)\n"
+            "         -x : The os-sim binary (default %s)\n"
+            "         -o : Write the CSV to a file instead of stdout\n"
+            "    Lists are separated by commas.  Each run is a separate"
+            " os-sim\n    process, as os-sim keeps its state in globals.\n",
+            simulator);
+}
+
+/* Splits a comma-separated list in place */
+static unsigned int split(char *list, char ***items)
+{
+    unsigned int count = 1, n = 0;
+    char *c, *item;
+
+    for (c = list; *c != '\0'; c++)
+        if (*c == ',')
+            count++;
+
+    *items = malloc(sizeof(char*) * count);
+    if (*items == NULL)
+        return 0;
+    for (item = strtok(list, ","); item != NULL; item = strtok(NULL, ","))
+        (*items)[n++] = item;
+    return n;
+}
+
+static const policy_t *find_policy(const char *name)
+{
+    unsigned int n;
+
+    for (n=0; n<sizeof(policies) / sizeof(policies[0]); n++)
+        if (strcmp(policies[n].name, name) == 0)
+            return &policies[n];
+    return NULL;
+}
+
+/*
+ * A walker over the JSON report, enough to look members up by key at one
+ * level without matching the same key inside a nested object or a string.
+ * Each function takes text at the start of a value, after any spaces.
+ */
+static const char *json_space(const char *text)
+{
+    while (*text == ' ' || *text == '\t' || *text == '\n' || *text == '\r')
+        text++;
+    return text;
+}
+
+/*
+ * json_string() copies the string at text into buf, truncated to size, and
+ * returns the text after it or NULL.  \u escapes are copied as '?'.
+ */
+static const char *json_string(const char *text, char *buf, size_t size)
+{
+    size_t used = 0;
+    char c;
+
+    if (*text++ != '"')
+        return NULL;
+    while ((c = *text++) != '"')
+    {
+        if (c == '\0')
+            return NULL;
+        if (c == '\\')
+        {
+            c = *text++;
+            if (c == '\0')
+                return NULL;
+            if (c == 'u')
+            {
+                if (strlen(text) < 4)
+                    return NULL;
+                text += 4;
+                c = '?';
+            }
+            else if (c == 'n')
+                c = '\n';
+            else if (c == 't')
+                c = '\t';
+        }
+        if (used + 1 < size)
+            buf[used++] = c;
+    }
+    if (size > 0)
+        buf[used] = '\0';
+    return text;
+}
+
+/* json_skip() returns the text after the value at text, or NULL */
+static const char *json_skip(const char *text)
+{
+    char close;
+
+    if (*text == '"')
+        return json_string(text, NULL, 0);
+    if (*text != '{' && *text != '[')
+    {
+        /* A number, true, false or null */
+        while (*text != '\0' && strchr(",}] \t\n\r", *text) == NULL)
+            text++;
+        return text;
+    }
+
+    close = *text == '{' ? '}' : ']';
+    text = json_space(text + 1);
+    if (*text == close)
+        return text + 1;
+    for (;;)
+    {
+        if (close == '}')
+        {
+            if ((text = json_string(text, NULL, 0)) == NULL)
+                return NULL;
+            text = json_space(text);
+            if (*text++ != ':')
+                return NULL;
+            text = json_space(text);
+        }
+        if ((text = json_skip(text)) == NULL)
+            return NULL;
+        text = json_space(text);
+        if (*text == close)
+            return text + 1;
+        if (*text++ != ',')
+            return NULL;
+        text = json_space(text);
+    }
+}
+
+/*
+ * json_member() returns the value of the member key of the object at text,
+ * or NULL if the object has none.
+ */
+static const char *json_member(const char *text, const char *key)
+{
+    char name[64];
+
+    if (*text != '{')
+        return NULL;
+    text = json_space(text + 1);
+    while (*text == '"')
+    {
+        if ((text = json_string(text, name, sizeof(name))) == NULL)
+            return NULL;
+        text = json_space(text);
+        if (*text++ != ':')
+            return NULL;
+        text = json_space(text);
+        if (strcmp(name, key) == 0)
+            return text;
+        if ((text = json_skip(text)) == NULL)
+            return NULL;
+        text = json_space(text);
+        if (*text != ',')
+            return NULL;
+        text = json_space(text + 1);
+    }
+    return NULL;
+}
+
+/* json_number() reads the number in member key of the object at text */
+static int json_number(const char *text, const char *key, double *value)
+{
+    const char *found = json_member(text, key);
+    char *end;
+
+    if (found == NULL)
+        return -1;
+    *value = strtod(found, &end);
+    return end == found ? -1 : 0;
+}
+
+/* find_class() returns the object of the class named name, or NULL */
+static const char *find_class(const char *report, const char *name)
+{
+    const char *entry = json_member(report, "classes");
+    const char *value;
+    char class[16];
+
+    if (entry == NULL || *entry != '[')
+        return NULL;
+    entry = json_space(entry + 1);
+    while (*entry == '{')
+    {
+        value = json_member(entry, "class");
+        if (value != NULL && json_string(value, class, sizeof(class)) != NULL &&
+            strcmp(class, name) == 0)
+            return entry;
+        if ((entry = json_skip(entry)) == NULL)
+            return NULL;
+        entry = json_space(entry);
+        if (*entry != ',')
+            return NULL;
+        entry = json_space(entry + 1);
+    }
+    return NULL;
+}
+
+static int parse_report(run_t *run, const char *text)
+{
+    const char *all, *metric;
+    double switches;
+    unsigned int m, p;
+
+    text = json_space(text);
+    if (json_number(text, "context_switches", &switches) != 0 ||
+        json_number(text, "execution_time", &run->execution_time) != 0 ||
+        json_number(text, "ready_time", &run->ready_time) != 0)
+        return -1;
+    run->context_switches = (unsigned long)switches;
+
+    all = find_class(text, "all");
+    if (all == NULL)
+        return -1;
+    for (m=0; m<METRIC_COUNT; m++)
+    {
+        metric = json_member(all, metrics[m]);
+        if (metric == NULL)
+            return -1;
+        for (p=0; p<PERCENTILE_COUNT; p++)
+            if (json_number(metric, percentiles[p], &run->times[m][p]) != 0)
+                return -1;
+    }
+    return 0;
+}
+
+static char *read_file(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    char *text = NULL;
+    size_t size = 0, used = 0, got;
+
+    if (file == NULL)
+        return NULL;
+    do
+    {
+        if (used + 1 >= size)
+        {
+            char *grown = realloc(text, size ? size * 2 : 4096);
+
+            if (grown == NULL)
+            {
+                free(text);
+                fclose(file);
+                return NULL;
+            }
+            text = grown;
+            size = size ? size * 2 : 4096;
+        }
+        got = fread(text + used, 1, size - used - 1, file);
+        used += got;
+    } while (got > 0);
+    text[used] = '\0';
+
+    fclose(file);
+    return text;
+}
+
+/*
+ * simulate() runs one os-sim in virtual time with its output thrown away,
+ * and fills in the run from its JSON report.
+ */
+static void simulate(run_t *run)
+{
+    char report[] = "/tmp/os-sweep-XXXXXX";
+    char cpus[16], slice[16];
+    const char *args[MAX_ARGS];
+    char *argv[MAX_ARGS];
+    posix_spawn_file_actions_t actions;
+    pid_t child;
+    int status, fd, n = 0, e;
+    char *text;
+
+    fd = mkstemp(report);
+    if (fd < 0)
+    {
+        perror("os-sweep: mkstemp");
+        return;
+    }
+    close(fd);
+
+    snprintf(cpus, sizeof(cpus), "%u", run->cpus);
+    snprintf(slice, sizeof(slice), "%u", run->slice);
+
+    args[n++] = simulator;
+    args[n++] = cpus;
+    for (e=0; e<2 && run->policy->options[e] != NULL; e++)
+        args[n++] = run->policy->options[e];
+    if (run->policy->slice_option != NULL)
+    {
+        args[n++] = run->policy->slice_option;
+        args[n++] = slice;
+    }
+    if (strcmp(run->workload, "builtin") != 0)
+    {
+        args[n++] = "-w";
+        args[n++] = run->workload;
+    }
+    args[n++] = "--fast";
+    args[n++] = "--no-gantt";
+    args[n++] = "--json";
+    args[n++] = report;
+    for (e=0; e<extra_count; e++)
+        args[n++] = extra_args[e];
+    args[n] = NULL;
+    /* posix_spawn() does not modify the arguments it is given */
+    memcpy(argv, args, sizeof(args));
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null",
+                                     O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null",
+                                     O_WRONLY, 0);
+    if (posix_spawn(&child, simulator, &actions, NULL, argv, environ) == 0 &&
+        waitpid(child, &status, 0) == child &&
+        WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+        (text = read_file(report)) != NULL)
+    {
+        run->ok = parse_report(run, text) == 0;
+        free(text);
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    unlink(report);
+
+    if (!run->ok)
+    {
+        fprintf(stderr, "os-sweep: %u CPUs, %s", run->cpus, run->policy->name);
+        if (run->policy->slice_option != NULL)
+            fprintf(stderr, " %u", run->slice);
+        fprintf(stderr, ", %s failed\n", run->workload);
+    }
+}
+
+static void *sweep_thread(void *data)
+{
+    unsigned int n;
+
+    (void)data;
+    while ((n = __atomic_fetch_add(&next_run, 1, __ATOMIC_RELAXED)) <
+           run_count)
+        simulate(&runs[n]);
+    return NULL;
+}
+
+static void print_csv(FILE *out)
+{
+    unsigned int n, m, p;
+
+    fprintf(out, "cpus,policy,slice,workload,context_switches,"
+            "execution_time,ready_time");
+    for (m=0; m<METRIC_COUNT; m++)
+        for (p=0; p<PERCENTILE_COUNT; p++)
+            fprintf(out, ",%s_%s", metrics[m], percentiles[p]);
+    fprintf(out, "\n");
+
+    for (n=0; n<run_count; n++)
+    {
+        run_t *run = &runs[n];
+
+        fprintf(out, "%u,%s,", run->cpus, run->policy->name);
+        if (run->policy->slice_option != NULL)
+            fprintf(out, "%u", run->slice);
+        fprintf(out, ",%s", run->workload);
+
+        /* A failed run keeps its row, with the results left empty */
+        if (!run->ok)
+        {
+            fprintf(out, ",,,");
+            for (m=0; m<METRIC_COUNT * PERCENTILE_COUNT; m++)
+                fprintf(out, ",");
+            fprintf(out, "\n");
+            continue;
+        }
+
+        fprintf(out, ",%lu,%.1f,%.1f", run->context_switches,
+                run->execution_time, run->ready_time);
+        for (m=0; m<METRIC_COUNT; m++)
+            for (p=0; p<PERCENTILE_COUNT; p++)
+                fprintf(out, ",%.1f", run->times[m][p]);
+        fprintf(out, "\n");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    char cpu_list[] = "1,2,4", policy_list[] = "fifo,rr";
+    char slice_list[] = "2,4,6,8", workload_list[] = "builtin";
+    char *cpu_arg = cpu_list, *policy_arg = policy_list;
+    char *slice_arg = slice_list, *workload_arg = workload_list;
+    char **cpu_items, **policy_items, **slice_items, **workloads;
+    unsigned int cpu_n, policy_n, slice_n, workload_n;
+    unsigned int c, p, s, w, n;
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned int jobs = online > 0 ? (unsigned int)online : 1;
+    const char *output = NULL;
+    pthread_t *threads;
+    FILE *out = stdout;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        const char *value;
+
+        if (strcmp(argv[i], "--") == 0)
+        {
+            extra_args = argv + i + 1;
+            extra_count = argc - i - 1;
+            break;
+        }
+        if (argv[i][0] != '-' || argv[i][1] == '\0' || argv[i][2] != '\0' ||
+            i + 1 >= argc)
+        {
+            usage(argv[0]);
+            return -1;
+        }
+        value = argv[++i];
+
+        switch (argv[i - 1][1])
+        {
+        /* The lists are split in place */
+        case 'c': cpu_arg = argv[i]; break;
+        case 'p': policy_arg = argv[i]; break;
+        case 'r': slice_arg = argv[i]; break;
+        case 'w': workload_arg = argv[i]; break;
+        case 'j': jobs = (unsigned int)strtoul(value, NULL, 10); break;
+        case 'x': simulator = value; break;
+        case 'o': output = value; break;
+        default:
+            usage(argv[0]);
+            return -1;
+        }
+    }
+
+    cpu_n = split(cpu_arg, &cpu_items);
+    policy_n = split(policy_arg, &policy_items);
+    slice_n = split(slice_arg, &slice_items);
+    workload_n = split(workload_arg, &workloads);
+    /* Leave room for the arguments simulate() adds itself */
+    if (cpu_n == 0 || policy_n == 0 || slice_n == 0 || workload_n == 0 ||
+        jobs == 0 || extra_count > MAX_ARGS - 16)
+    {
+        usage(argv[0]);
+        return -1;
+    }
+
+    for (p=0; p<policy_n; p++)
+        if (find_policy(policy_items[p]) == NULL)
+        {
+            fprintf(stderr, "%s: unknown policy %s\n", argv[0],
+                    policy_items[p]);
+            return -1;
+        }
+
+    /* Laid out in CSV order, one slice only for the unsliced policies */
+    runs = calloc((size_t)cpu_n * policy_n * slice_n * workload_n,
+                  sizeof(run_t));
+    if (runs == NULL)
+    {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return -1;
+    }
+    for (c=0; c<cpu_n; c++)
+        for (p=0; p<policy_n; p++)
+        {
+            const policy_t *policy = find_policy(policy_items[p]);
+
+            for (s=0; s<(policy->slice_option != NULL ? slice_n : 1); s++)
+                for (w=0; w<workload_n; w++)
+                {
+                    run_t *run = &runs[run_count++];
+
+                    run->cpus = (unsigned int)strtoul(cpu_items[c], NULL, 10);
+                    run->policy = policy;
+                    run->slice = policy->slice_option != NULL ?
+                        (unsigned int)strtoul(slice_items[s], NULL, 10) : 0;
+                    run->workload = workloads[w];
+                }
+        }
+
+    if (output != NULL && (out = fopen(output, "w")) == NULL)
+    {
+        perror(output);
+        return -1;
+    }
+
+    if (jobs > run_count)
+        jobs = run_count;
+    threads = malloc(sizeof(pthread_t) * jobs);
+    if (threads == NULL)
+    {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return -1;
+    }
+    for (n=0; n<jobs; n++)
+        pthread_create(&threads[n], NULL, sweep_thread, NULL);
+    for (n=0; n<jobs; n++)
+        pthread_join(threads[n], NULL);
+
+    print_csv(out);
+    if (out != stdout)
+        fclose(out);
+
+    for (n=0; n<run_count; n++)
+        if (!runs[n].ok)
+            return 1;
+    return 0;
+}
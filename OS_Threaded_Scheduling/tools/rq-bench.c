@@ -0,0 +1,161 @@
+/*
+ * rq-bench.c
+ * Ready queue contention benchmark for os-sim
+ *
+ * Every thread repeatedly pushes the PCB it holds onto one shared ready
+ * queue and pops a PCB back off, like CPUs preempting and dispatching on a
+ * single run queue.  The queue is either a FIFO behind a mutex, as without
+ * --lock-free, or the lock-free MPMC queue.  The throughput is printed for
+ * a doubling number of threads.
+ *
+ * The MPMC queue is meant to win at 16 or more CPUs, but that has not been
+ * measured: so far this has only run on a single core, where every extra
+ * thread just time-slices with the others.  There the mutex FIFO is faster
+ * at every thread count (39 vs 27 Mops/s with one thread, 38 vs 7 with
+ * 16), because a thread preempted between claiming a slot and publishing
+ * it stalls everyone behind it.  Until a many-core run shows otherwise,
+ * --lock-free stays experimental.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "os-sim.h"
+#include "ready-queue.h"
+
+/* PCBs queued before the threads start, so pops rarely find it empty */
+#define PREFILL 64
+
+typedef struct {
+    ready_queue_t *queue;
+    pthread_mutex_t *mutex;
+    pcb_t *held;
+    unsigned long iterations;
+} bench_thread_t;
+
+static pthread_barrier_t start_barrier;
+
+static void *bench_thread(void *data);
+static double run(unsigned int threads, unsigned long iterations,
+                  int lock_free);
+
+
+static void *bench_thread(void *data)
+{
+    bench_thread_t *t = data;
+    pcb_t *pcb = t->held;
+    unsigned long n;
+
+    pthread_barrier_wait(&start_barrier);
+    for (n=0; n<t->iterations; n++)
+    {
+        if (t->mutex != NULL)
+        {
+            pthread_mutex_lock(t->mutex);
+            rq_push(t->queue, pcb);
+            pcb = rq_pop(t->queue);
+            pthread_mutex_unlock(t->mutex);
+        }
+        else
+        {
+            rq_push(t->queue, pcb);
+            /* Another thread can take every PCB between push and pop */
+            while ((pcb = rq_pop(t->queue)) == NULL)
+                sched_yield();
+        }
+    }
+    t->held = pcb;
+    return NULL;
+}
+
+/* run() returns the throughput in million push/pop pairs per second */
+static double run(unsigned int threads, unsigned long iterations,
+                  int lock_free)
+{
+    unsigned int count = PREFILL + threads, n;
+    pthread_mutex_t mutex;
+    bench_thread_t *data;
+    pthread_t *thread;
+    struct timespec begin, end;
+    ready_queue_t *queue;
+    pcb_t *pcbs;
+    double seconds;
+
+    pcbs = malloc(sizeof(pcb_t) * count);
+    data = malloc(sizeof(bench_thread_t) * threads);
+    thread = malloc(sizeof(pthread_t) * threads);
+    assert(pcbs != NULL && data != NULL && thread != NULL);
+    for (n=0; n<count; n++)
+    {
+        /* pid is const, so the PCB is initialized as a whole */
+        pcb_t pcb = { n, "bench", 0, PROCESS_READY, NULL, NULL, 0, 0, 0, 0,
+                      0, n };
+        memcpy(&pcbs[n], &pcb, sizeof(pcb_t));
+    }
+
+    queue = lock_free ? rq_create_mpmc(count) : rq_create_fifo();
+    pthread_mutex_init(&mutex, NULL);
+    for (n=0; n<PREFILL; n++)
+        rq_push(queue, &pcbs[n]);
+
+    pthread_barrier_init(&start_barrier, NULL, threads + 1);
+    for (n=0; n<threads; n++)
+    {
+        data[n].queue = queue;
+        data[n].mutex = lock_free ? NULL : &mutex;
+        data[n].held = &pcbs[PREFILL + n];
+        data[n].iterations = iterations;
+        pthread_create(&thread[n], NULL, bench_thread, &data[n]);
+    }
+
+    pthread_barrier_wait(&start_barrier);
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (n=0; n<threads; n++)
+        pthread_join(thread[n], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    /* Every PCB must still be either queued or held */
+    assert(rq_size(queue) == PREFILL);
+
+    pthread_barrier_destroy(&start_barrier);
+    pthread_mutex_destroy(&mutex);
+    rq_destroy(queue);
+    free(thread);
+    free(data);
+    free(pcbs);
+
+    seconds = (double)(end.tv_sec - begin.tv_sec) +
+              (double)(end.tv_nsec - begin.tv_nsec) / 1e9;
+    return (double)iterations * threads / seconds / 1e6;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long iterations = 1000000;
+    unsigned int max_threads = 32, threads;
+
+    if (argc > 1)
+        iterations = strtoul(argv[1], NULL, 0);
+    if (argc > 2)
+        max_threads = (unsigned int)strtoul(argv[2], NULL, 0);
+    if (argc > 3 || iterations == 0 || max_threads == 0)
+    {
+        fprintf(stderr, "Usage: %s [iterations per thread] [max threads]\n",
+                argv[0]);
+        return -1;
+    }
+
+    printf("Threads  Mutex FIFO (Mops/s)  Lock-free MPMC (Mops/s)\n");
+    for (threads=1; threads<=max_threads; threads*=2)
+    {
+        printf("%-8u %-20.2f %.2f\n", threads,
+               run(threads, iterations, 0), run(threads, iterations, 1));
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,219 @@
+/*
+ * workload-gen.c
+ * Synthetic workload generator for os-sim
+ *
+ * Writes a workload file in the format read by os-sim -w:
+ *
+ *   <name> <arrival tick> <priority> <cpu> [<io> <cpu>]...
+ *
+ * Each process is either CPU-bound or I/O-bound.  CPU-bound processes get
+ * long CPU bursts and short I/O, I/O-bound processes the opposite.  Burst
+ * lengths are drawn from the chosen distribution around the given means,
+ * and arrivals are a Poisson process with the given mean gap.  With -t,
+ * CPU-bound processes have several threads, each with its own bursts.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+    DIST_EXPONENTIAL,
+    DIST_BIMODAL,
+    DIST_PARETO
+} dist_t;
+
+static unsigned int count = 1000;
+static dist_t dist = DIST_EXPONENTIAL;
+static double cpu_mean = 8.0;
+static double io_mean = 4.0;
+static unsigned int bursts = 5;
+static double arrival_mean = 5.0;
+static double io_fraction = 0.5;
+static unsigned int nice_range = 0;
+static unsigned int threads = 1;
+static unsigned long long seed = 1;
+
+static void usage(const char *prog);
+static unsigned long long rng_next(void);
+static double rng_uniform(void);
+static double sample(double mean);
+static unsigned int burst(double mean);
+
+
+/* xorshift64*, so workloads do not depend on the libc rand() */
+static unsigned long long rng_state;
+
+static unsigned long long rng_next(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ull;
+}
+
+/* Uniform in (0, 1], so it is safe to take the log of */
+static double rng_uniform(void)
+{
+    return (double)((rng_next() >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+/*
+ * sample() draws one value with the given mean from the chosen distribution.
+ *
+ *   exponential: the classic memoryless burst model
+ *   bimodal: 80% short bursts at mean/2, 20% long bursts at 3*mean
+ *   pareto: heavy-tailed with shape 1.5, so a few bursts dominate
+ */
+static double sample(double mean)
+{
+    const double shape = 1.5;
+
+    switch (dist)
+    {
+    case DIST_BIMODAL:
+        if (rng_uniform() <= 0.8)
+            return -log(rng_uniform()) * mean / 2.0;
+        return -log(rng_uniform()) * mean * 3.0;
+
+    case DIST_PARETO:
+        /* Scale chosen so that the mean is shape * xm / (shape - 1) */
+        return mean * (shape - 1.0) / shape * pow(rng_uniform(), -1.0 / shape);
+
+    case DIST_EXPONENTIAL:
+    default:
+        return -log(rng_uniform()) * mean;
+    }
+}
+
+/* Bursts are whole ticks, and at least one */
+static unsigned int burst(double mean)
+{
+    double value = sample(mean) + 0.5;
+
+    if (value < 1.0)
+        return 1;
+    if (value > 1e6)
+        return 1000000;
+    return (unsigned int)value;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [options]\n"
+            "         -n : Number of processes (default %u)\n"
+            "         -d : Burst distribution: exp, bimodal or pareto"
+            " (default exp)\n"
+            "         -c : Mean CPU burst in ticks (default %.1f)\n"
+            "         -i : Mean I/O burst in ticks (default %.1f)\n"
+            "         -b : CPU bursts per process (default %u)\n"
+            "         -a : Mean ticks between arrivals (default %.1f)\n"
+            "         -f : Fraction of I/O-bound processes (default %.2f)\n"
+            "         -p : Draw priorities uniformly from -p..p (default %u)\n"
+            "         -t : Threads per CPU-bound process (default %u)\n"
+            "         -s : Random seed (default %llu)\n",
+            prog, count, cpu_mean, io_mean, bursts, arrival_mean,
+            io_fraction, nice_range, threads, seed);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int n, b, t;
+    double arrival = 0.0;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        const char *value;
+
+        if (argv[i][0] != '-' || argv[i][1] == '\0' || argv[i][2] != '\0' ||
+            i + 1 >= argc)
+        {
+            usage(argv[0]);
+            return -1;
+        }
+        value = argv[++i];
+
+        switch (argv[i - 1][1])
+        {
+        case 'n': count = (unsigned int)strtoul(value, NULL, 10); break;
+        case 'c': cpu_mean = atof(value); break;
+        case 'i': io_mean = atof(value); break;
+        case 'b': bursts = (unsigned int)strtoul(value, NULL, 10); break;
+        case 'a': arrival_mean = atof(value); break;
+        case 'f': io_fraction = atof(value); break;
+        case 'p': nice_range = (unsigned int)strtoul(value, NULL, 10); break;
+        case 't': threads = (unsigned int)strtoul(value, NULL, 10); break;
+        case 's': seed = strtoull(value, NULL, 10); break;
+        case 'd':
+            if (strcmp(value, "exp") == 0)
+                dist = DIST_EXPONENTIAL;
+            else if (strcmp(value, "bimodal") == 0)
+                dist = DIST_BIMODAL;
+            else if (strcmp(value, "pareto") == 0)
+                dist = DIST_PARETO;
+            else
+            {
+                usage(argv[0]);
+                return -1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if (count == 0 || bursts == 0 || threads == 0 ||
+        cpu_mean <= 0.0 || io_mean <= 0.0 ||
+        arrival_mean < 0.0 || io_fraction < 0.0 || io_fraction > 1.0)
+    {
+        fprintf(stderr, "%s: need at least one process and burst, positive"
+                " burst means and an I/O fraction between 0 and 1\n", argv[0]);
+        return -1;
+    }
+
+    rng_state = seed ? seed : 1;
+
+    printf("# workload-gen -n %u -d %s -c %g -i %g -b %u -a %g -f %g -p %u"
+           " -t %u -s %llu\n", count, dist == DIST_BIMODAL ? "bimodal" :
+           dist == DIST_PARETO ? "pareto" : "exp",
+           cpu_mean, io_mean, bursts, arrival_mean, io_fraction, nice_range,
+           threads, seed);
+    printf("# name arrival priority cpu [io cpu]...\n");
+
+    for (n=0; n<count; n++)
+    {
+        int io_bound = rng_uniform() <= io_fraction;
+        /* I/O-bound processes swap the long and short burst */
+        double cpu = io_bound ? cpu_mean / 4.0 : cpu_mean;
+        double io = io_bound ? io_mean * 2.0 : io_mean / 2.0;
+        int priority = 0;
+
+        if (nice_range > 0)
+            priority = (int)(rng_next() % (2 * nice_range + 1)) -
+                       (int)nice_range;
+
+        printf("%c%u %u %d", io_bound ? 'I' : 'C', n, (unsigned int)arrival,
+               priority);
+        for (t=0; t<(io_bound ? 1 : threads); t++)
+        {
+            /* Each further thread is a + line with its own bursts */
+            if (t > 0)
+                printf("+");
+            for (b=0; b<bursts; b++)
+            {
+                if (b > 0)
+                    printf(" %u", burst(io));
+                printf(" %u", burst(cpu));
+            }
+            printf("\n");
+        }
+
+        if (arrival_mean > 0.0)
+            arrival += -log(rng_uniform()) * arrival_mean;
+    }
+
+    return 0;
+}